@@ -0,0 +1,1404 @@
+/* bench.c */
+
+/*
+    Copyright (C) 2023  Maurice Lambert
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*
+    Benchmarks: one CSV line by public function and list size
+    (function,size,operations,ns_per_op,ops_per_s,allocations_per_op,cycles_per_op,cache_misses_per_op)
+    then workload benchmarks as comment lines (starting with '#').
+
+    Allocations are counted by wrapping malloc, calloc and realloc at link time
+    (-Wl,--wrap=...), hardware counters are read with perf_event_open when
+    the kernel allows it (empty columns otherwise).
+
+    Usage: ./proclist_bench [maximum list size, default 1000000]
+*/
+
+#include  "proclist.h"
+#include  "fixtures.h"
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pwd.h>
+#include <sys/wait.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *pointer, size_t size);
+
+static atomic_ullong allocations;
+
+/*
+  * These functions count allocations (linked with -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc).
+*/
+void *__wrap_malloc(size_t size) {
+    atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+    atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+    return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *pointer, size_t size) {
+    atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+    return __real_realloc(pointer, size);
+}
+
+static int perf_cycles = -1;             // perf_event_open group leader, -1: not available
+static int perf_misses = -1;
+
+typedef struct Measure {
+    double start;
+    unsigned long long allocations;
+} Measure;
+
+/*
+  * This function opens the cycles and cache misses counters of this thread.
+*/
+void open_perf_counters(void) {
+    struct perf_event_attr attributes;
+    memset(&attributes, 0, sizeof(attributes));
+    attributes.type = PERF_TYPE_HARDWARE;
+    attributes.size = sizeof(attributes);
+    attributes.config = PERF_COUNT_HW_CPU_CYCLES;
+    attributes.disabled = 1;
+    attributes.exclude_kernel = 1;
+    attributes.exclude_hv = 1;
+    attributes.read_format = PERF_FORMAT_GROUP;
+
+    perf_cycles = syscall(SYS_perf_event_open, &attributes, 0, -1, -1, 0);
+    if (perf_cycles < 0) return;
+
+    attributes.config = PERF_COUNT_HW_CACHE_MISSES;
+    attributes.disabled = 0;
+    perf_misses = syscall(SYS_perf_event_open, &attributes, 0, -1, perf_cycles, 0);
+
+    if (perf_misses < 0) {
+        close(perf_cycles);
+        perf_cycles = -1;
+    }
+}
+
+/*
+  * This function starts a measure.
+*/
+void begin_measure(Measure *measure) {
+    if (perf_cycles >= 0) {
+        ioctl(perf_cycles, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(perf_cycles, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+
+    measure->allocations = atomic_load(&allocations);
+    measure->start = now_ns();
+}
+
+/*
+  * This function ends a measure and prints its CSV line.
+*/
+void end_measure(Measure *measure, const char *function, unsigned int size, unsigned long long operations) {
+    double elapsed = now_ns() - measure->start;
+    unsigned long long allocated = atomic_load(&allocations) - measure->allocations;
+    char cycles[32] = "", misses[32] = "";
+    if (operations == 0) operations = 1;
+
+    if (perf_cycles >= 0) {
+        ioctl(perf_cycles, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+        unsigned long long values[3];
+        if (read(perf_cycles, values, sizeof(values)) == sizeof(values)) {
+            snprintf(cycles, sizeof(cycles), "%.1f", (double)values[1] / operations);
+            snprintf(misses, sizeof(misses), "%.3f", (double)values[2] / operations);
+        }
+    }
+
+    printf("%s,%u,%llu,%.2f,%.0f,%.3f,%s,%s\n", function, size, operations, elapsed / operations, operations / (elapsed / 1e9), (double)allocated / operations, cycles, misses);
+}
+
+static unsigned long long random_state = 88172645463325252ull;
+
+/*
+  * This function returns a pseudo random number (xorshift64), runs are reproducible.
+*/
+unsigned int next_random(void) {
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 7;
+    random_state ^= random_state << 17;
+    return random_state >> 32;
+}
+
+/*
+  * This function builds a pooled list of size processes (PIDs 1 to size,
+  * a binary process tree, usages and 64 distinct command lines).
+*/
+StartProcList *build_list(unsigned int size) {
+    static const char *users[4] = {"root", "postgres", "www-data", "daemon"};
+    char cmdline[64];
+    StartProcList *list = malloc(sizeof(StartProcList));
+    init_proc_list_with_pool(list, 0);
+
+    for (unsigned int pid = 1; pid <= size; pid += 1) {
+        ProcessElementList *process = new_proc(list);
+        process->pid = pid;
+        process->ppid = pid / 2;
+        process->cpu_usage = (next_random() % 10000) / 100.0f;
+        process->memory_usage = (next_random() % 10000) / 100.0f;
+        process->start_timestamp = 1466607358.0 + pid;
+        process->tty = pid % 2;
+        snprintf(cmdline, sizeof(cmdline), "/usr/bin/worker --queue %u --verbose", pid % 64);
+        set_proc_strings(list, process, "/usr/bin/worker", cmdline, users[pid % 4]);
+        add_proc(list, process);
+    }
+
+    return list;
+}
+
+/*
+  * This function returns the operations for a linear time function (bounded run time).
+*/
+unsigned int linear_operations(unsigned int size) {
+    unsigned long long operations = 100000000ull / size;
+    if (operations > size) operations = size;
+    return operations ? operations : 1;
+}
+
+/*
+  * This function benchmarks insertions, removals and accesses of a list of size processes.
+*/
+void bench_list_functions(unsigned int size) {
+    Measure measure;
+    unsigned int operations = linear_operations(size);
+    unsigned int changes = size < 10000 ? size : 10000;
+    ProcessElementList **processes = malloc(size * sizeof(ProcessElementList *));
+    ProcessElementList **extra = malloc(changes * sizeof(ProcessElementList *));
+    for (unsigned int pid = 0; pid < size; pid += 1) processes[pid] = make_proc(pid + 1, 0);
+
+    StartProcList *list = malloc(sizeof(StartProcList));
+    init_proc_list(list);
+    begin_measure(&measure);
+    for (unsigned int position = 0; position < size; position += 1) add_proc(list, processes[position]);
+    end_measure(&measure, "add_proc", size, size);
+
+    init_proc_list(list);
+    begin_measure(&measure);
+    add_procs(list, processes, size);
+    end_measure(&measure, "add_procs", size, size);
+
+    goto_first_position(list);
+    begin_measure(&measure);
+    while (get_next_proc(list) != NULL) {}
+    end_measure(&measure, "get_next_proc", size, size);
+
+    goto_last_position(list);
+    begin_measure(&measure);
+    while (get_precedent_proc(list) != NULL) {}
+    end_measure(&measure, "get_precedent_proc", size, size);
+
+    begin_measure(&measure);
+    for (unsigned int position = 0; position < size; position += 1) goto_first_position(list);
+    end_measure(&measure, "goto_first_position", size, size);
+
+    begin_measure(&measure);
+    for (unsigned int position = 0; position < size; position += 1) goto_last_position(list);
+    end_measure(&measure, "goto_last_position", size, size);
+
+    begin_measure(&measure);
+    for (unsigned int position = 0; position < operations; position += 1) get_proc(list, next_random() % size);
+    end_measure(&measure, "get_proc", size, operations);
+
+    begin_measure(&measure);
+    for (unsigned int position = 0; position < operations; position += 1) get_proc_pid(list, next_random() % size + 1);
+    end_measure(&measure, "get_proc_pid", size, operations);
+
+    begin_measure(&measure);
+    enable_proc_pid_index(list);
+    end_measure(&measure, "enable_proc_pid_index", size, size);
+
+    begin_measure(&measure);
+    for (unsigned int position = 0; position < size; position += 1) get_proc_pid(list, next_random() % size + 1);
+    end_measure(&measure, "get_proc_pid/index", size, size);
+
+    begin_measure(&measure);
+    enable_proc_positions(list);
+    end_measure(&measure, "enable_proc_positions", size, size);
+
+    begin_measure(&measure);
+    for (unsigned int position = 0; position < size; position += 1) get_proc(list, next_random() % size);
+    end_measure(&measure, "get_proc/positions", size, size);
+
+    for (unsigned int position = 0; position < changes; position += 1) extra[position] = make_proc(size + position + 1, 0);
+    begin_measure(&measure);
+    for (unsigned int position = 0; position < changes; position += 1) insert_proc(list, extra[position], next_random() % (list->length + 1));
+    end_measure(&measure, "insert_proc/positions", size, changes);
+
+    begin_measure(&measure);
+    for (unsigned int position = 0; position < changes; position += 1) remove_proc_index(list, next_random() % list->length);
+    end_measure(&measure, "remove_proc_index/positions", size, changes);
+
+    for (unsigned int position = 0; position < changes; position += 1) extra[position] = make_proc(size + position + 1, 0);
+    begin_measure(&measure);
+    for (unsigned int position = 0; position < changes; position += 1) insert_after_proc(list, extra[position], list->first);
+    end_measure(&measure, "insert_after_proc/positions", size, changes);
+
+    begin_measure(&measure);
+    for (unsigned int position = 0; position < changes; position += 1) remove_proc(list, extra[position]);
+    end_measure(&measure, "remove_proc/positions", size, changes);
+
+    for (unsigned int position = 0; position < changes; position += 1) extra[position] = make_proc(size + position + 1, 0);
+    begin_measure(&measure);
+    for (unsigned int position = 0; position < changes; position += 1) insert_before_proc(list, extra[position], list->last);
+    end_measure(&measure, "insert_before_proc/positions", size, changes);
+
+    begin_measure(&measure);
+    for (unsigned int position = 0; position < changes / 2; position += 1) extra[position] = pop_proc(list);
+    end_measure(&measure, "pop_proc/positions", size, changes / 2);
+
+    begin_measure(&measure);
+    for (unsigned int position = changes / 2; position < changes; position += 1) extra[position] = popleft_proc(list);
+    end_measure(&measure, "popleft_proc/positions", size, changes - changes / 2);
+
+    for (unsigned int position = 0; position < changes; position += 1) add_proc(list, extra[position]);
+    begin_measure(&measure);
+    clean_proc_list(list);
+    end_measure(&measure, "clean_proc_list", size, size);
+
+    StartProcList *first = malloc(sizeof(StartProcList));
+    StartProcList *second = malloc(sizeof(StartProcList));
+    init_proc_list(first);
+    init_proc_list(second);
+    for (unsigned int pid = 0; pid < size; pid += 1) add_proc(pid < size / 2 ? first : second, make_proc(pid + 1, 0));
+
+    begin_measure(&measure);
+    splice_proc_list(first, second, first->last);
+    end_measure(&measure, "splice_proc_list", size, 1);
+
+    ProcessElementList *middle = get_proc(first, size / 2);
+    begin_measure(&measure);
+    split_proc_list(first, middle, second);
+    end_measure(&measure, "split_proc_list", size, size - size / 2);
+
+    clean_proc_list(first);
+    clean_proc_list(second);
+
+    // independent pools and string tables are merged by the splice
+    first = build_list(size / 2 ? size / 2 : 1);
+    second = build_list(size - size / 2);
+    begin_measure(&measure);
+    splice_proc_list(first, second, first->last);
+    end_measure(&measure, "splice_proc_list/pools", size, 1);
+
+    clean_proc_list(second);
+    clean_proc_list(first);
+    free(processes);
+    free(extra);
+}
+
+/*
+  * This function benchmarks node and string allocations for size processes.
+*/
+void bench_memory_functions(unsigned int size) {
+    Measure measure;
+    ProcessElementList **processes = malloc(size * sizeof(ProcessElementList *));
+    char cmdline[64];
+
+    for (char pooled = 0; pooled < 2; pooled += 1) {
+        StartProcList *list = malloc(sizeof(StartProcList));
+        init_proc_list(list);
+
+        begin_measure(&measure);
+        if (pooled) enable_proc_pool(list, 0);
+        enable_proc_strings(list);
+        end_measure(&measure, pooled ? "enable_proc_pool+enable_proc_strings" : "enable_proc_strings", size, 1);
+
+        begin_measure(&measure);
+        for (unsigned int position = 0; position < size; position += 1) processes[position] = pooled ? new_proc(list) : make_proc(0, 0);
+        end_measure(&measure, pooled ? "new_proc/pool" : "calloc", size, size);
+
+        begin_measure(&measure);
+        for (unsigned int position = 0; position < size; position += 1) {
+            snprintf(cmdline, sizeof(cmdline), "/usr/bin/worker --queue %u", position % 64);
+            set_proc_strings(list, processes[position], "/usr/bin/worker", cmdline, "root");
+        }
+        end_measure(&measure, "set_proc_strings", size, size);
+
+        begin_measure(&measure);
+        for (unsigned int position = 0; position < size; position += 1) count_proc_strings(list);
+        end_measure(&measure, "count_proc_strings", size, size);
+
+        begin_measure(&measure);
+        for (unsigned int position = 0; position < size; position += 1) count_proc_pool_chunks(list);
+        end_measure(&measure, "count_proc_pool_chunks", size, size);
+
+        begin_measure(&measure);
+        for (unsigned int position = 0; position < size; position += 1) free_proc(list, processes[position]);
+        end_measure(&measure, pooled ? "free_proc/pool" : "free_proc/calloc", size, size);
+
+        clean_proc_list(list);
+    }
+
+    StartProcList *list = malloc(sizeof(StartProcList));
+    begin_measure(&measure);
+    init_proc_list_with_pool(list, 0);
+    end_measure(&measure, "init_proc_list_with_pool", size, 1);
+
+    for (unsigned int pid = 0; pid < size; pid += 1) add_proc(list, new_proc(list));
+    begin_measure(&measure);
+    clean_proc_list(list);
+    end_measure(&measure, "clean_proc_list/pool", size, size);
+    free(processes);
+}
+
+/*
+  * This function benchmarks sorting, sorted views, top-K and iterators on size processes.
+*/
+void bench_order_functions(unsigned int size) {
+    Measure measure;
+    StartProcList *list = build_list(size);
+    ProcCompare compares[4] = {compare_proc_pid, compare_proc_start_timestamp, compare_proc_cpu_usage, compare_proc_memory_usage};
+    const char *compare_names[4] = {"compare_proc_pid", "compare_proc_start_timestamp", "compare_proc_cpu_usage", "compare_proc_memory_usage"};
+
+    for (unsigned int compare = 0; compare < 4; compare += 1) {
+        int total = 0;
+        begin_measure(&measure);
+        for (ProcessElementList *process = list->first; process->next != NULL; process = process->next) total += compares[compare](process, process->next);
+        end_measure(&measure, compare_names[compare], size, size - 1 ? size - 1 : 1);
+        if (total == 42) puts("#");
+    }
+
+    begin_measure(&measure);
+    sort_proc_list(list, compare_proc_cpu_usage);
+    end_measure(&measure, "sort_proc_list", size, size);
+
+    ProcSortedView view;
+    begin_measure(&measure);
+    init_proc_view(&view, list, compare_proc_memory_usage);
+    end_measure(&measure, "init_proc_view", size, size);
+
+    for (ProcessElementList *process = list->first; process != NULL; process = process->next) {
+        if (next_random() % 100 == 0) process->memory_usage = (next_random() % 10000) / 100.0f;
+    }
+    begin_measure(&measure);
+    update_proc_view(&view, NULL);
+    end_measure(&measure, "update_proc_view/1%", size, size);
+
+    begin_measure(&measure);
+    free_proc_view(&view);
+    end_measure(&measure, "free_proc_view", size, 1);
+
+    ProcTopK top;
+    init_proc_top(&top, 10, compare_proc_cpu_usage);
+    begin_measure(&measure);
+    fill_proc_top(&top, list);
+    end_measure(&measure, "fill_proc_top", size, size);
+
+    init_proc_top(&top, 10, compare_proc_cpu_usage);
+    begin_measure(&measure);
+    for (ProcessElementList *process = list->first; process != NULL; process = process->next) push_proc_top(&top, process);
+    end_measure(&measure, "push_proc_top", size, size);
+
+    unsigned int updates = size < 100000 ? size : 100000;
+    begin_measure(&measure);
+    for (unsigned int position = 0; position < updates; position += 1) {
+        ProcessElementList *process = top.heap[next_random() % top.length];
+        process->cpu_usage = (next_random() % 10000) / 100.0f;
+        update_proc_top(&top, process);
+    }
+    end_measure(&measure, "update_proc_top", size, updates);
+
+    ProcessElementList *kept[10];
+    begin_measure(&measure);
+    unsigned int kept_length = get_proc_top(&top, kept);
+    end_measure(&measure, "get_proc_top", size, 1);
+
+    begin_measure(&measure);
+    for (unsigned int position = 0; position < kept_length; position += 1) remove_proc_top(&top, kept[position]);
+    end_measure(&measure, "remove_proc_top", size, kept_length ? kept_length : 1);
+    free_proc_top(&top);
+
+    ProcIterator iterator;
+    init_proc_iterator(list, &iterator);
+    begin_measure(&measure);
+    while (get_next_iterator_proc(&iterator) != NULL) {}
+    end_measure(&measure, "get_next_iterator_proc", size, size);
+
+    goto_last_iterator_position(&iterator);
+    begin_measure(&measure);
+    while (get_precedent_iterator_proc(&iterator) != NULL) {}
+    end_measure(&measure, "get_precedent_iterator_proc", size, size);
+
+    set_proc_iterator_filter(&iterator, even_pid_filter, NULL);
+    goto_first_iterator_position(&iterator);
+    begin_measure(&measure);
+    while (get_next_iterator_proc(&iterator) != NULL) {}
+    end_measure(&measure, "get_next_iterator_proc/filter", size, size);
+
+    unsigned int operations = linear_operations(size);
+    begin_measure(&measure);
+    for (unsigned int position = 0; position < operations; position += 1) seek_iterator_pid(&iterator, next_random() % size + 1);
+    end_measure(&measure, "seek_iterator_pid", size, operations);
+
+    enable_proc_pid_index(list);
+    begin_measure(&measure);
+    for (unsigned int position = 0; position < size; position += 1) seek_iterator_pid(&iterator, next_random() % size + 1);
+    end_measure(&measure, "seek_iterator_pid/index", size, size);
+
+    clean_proc_list(list);
+}
+
+/*
+  * This function benchmarks snapshots, trees, snapshot files, publication and history on size processes.
+*/
+void bench_snapshot_functions(unsigned int size) {
+    Measure measure;
+    StartProcList *list = build_list(size);
+
+    ProcSnapshot snapshot;
+    begin_measure(&measure);
+    export_proc_snapshot(list, &snapshot);
+    end_measure(&measure, "export_proc_snapshot", size, size);
+
+    double total = 0;
+    begin_measure(&measure);
+    total += sum_snapshot_values(snapshot.cpu, snapshot.length);
+    end_measure(&measure, "sum_snapshot_values", size, size);
+
+    unsigned int *indexes = malloc(size * sizeof(unsigned int));
+    begin_measure(&measure);
+    total += filter_snapshot_values(snapshot.cpu, snapshot.length, 50, indexes);
+    end_measure(&measure, "filter_snapshot_values", size, size);
+
+    begin_measure(&measure);
+    total += top_snapshot_values(snapshot.cpu, snapshot.length, 10, indexes);
+    end_measure(&measure, "top_snapshot_values", size, size);
+
+    begin_measure(&measure);
+    free_proc_snapshot(&snapshot);
+    end_measure(&measure, "free_proc_snapshot", size, 1);
+
+    ProcTree tree;
+    begin_measure(&measure);
+    build_proc_tree(list, &tree);
+    end_measure(&measure, "build_proc_tree", size, size);
+
+    ProcessElementList **subtree;
+    begin_measure(&measure);
+    total += get_proc_subtree(&tree, 1, &subtree);
+    end_measure(&measure, "get_proc_subtree", size, 1);
+
+    ProcessElementList *children[8];
+    begin_measure(&measure);
+    for (unsigned int position = 0; position < size; position += 1) total += get_proc_children(&tree, next_random() % size + 1, children, 8);
+    end_measure(&measure, "get_proc_children", size, size);
+
+    begin_measure(&measure);
+    for (unsigned int position = 0; position < size; position += 1) total += get_proc_tree_parent(&tree, next_random() % size + 1) != NULL;
+    end_measure(&measure, "get_proc_tree_parent", size, size);
+
+    begin_measure(&measure);
+    for (unsigned int position = 0; position < size; position += 1) total += get_proc_subtree_cpu(&tree, next_random() % size + 1);
+    end_measure(&measure, "get_proc_subtree_cpu", size, size);
+
+    begin_measure(&measure);
+    for (unsigned int position = 0; position < size; position += 1) total += get_proc_subtree_memory(&tree, next_random() % size + 1);
+    end_measure(&measure, "get_proc_subtree_memory", size, size);
+
+    begin_measure(&measure);
+    free_proc_tree(&tree);
+    end_measure(&measure, "free_proc_tree", size, 1);
+
+    char path[] = "/tmp/proclist_bench_snapshot.bin";
+    begin_measure(&measure);
+    write_proc_snapshot_file(list, path);
+    end_measure(&measure, "write_proc_snapshot_file", size, size);
+
+    ProcSnapshotFile file;
+    begin_measure(&measure);
+    open_proc_snapshot_file(&file, path);
+    end_measure(&measure, "open_proc_snapshot_file", size, 1);
+
+    begin_measure(&measure);
+    for (unsigned int position = 0; position < size; position += 1) total += get_proc_record(&file, next_random() % size)->cpu_usage;
+    end_measure(&measure, "get_proc_record", size, size);
+
+    begin_measure(&measure);
+    for (unsigned int position = 0; position < size; position += 1) total += get_proc_record_string(&file, get_proc_record(&file, position)->cmdline)[0];
+    end_measure(&measure, "get_proc_record_string", size, size);
+
+    begin_measure(&measure);
+    close_proc_snapshot_file(&file);
+    end_measure(&measure, "close_proc_snapshot_file", size, 1);
+    remove(path);
+
+    ProcPublisher *publisher = create_proc_publisher();
+    ProcReader reader;
+    register_proc_reader(publisher, &reader);
+    begin_measure(&measure);
+    publish_proc_list(publisher, list);
+    end_measure(&measure, "publish_proc_list", size, size);
+
+    begin_measure(&measure);
+    for (unsigned int position = 0; position < 1000000; position += 1) {
+        total += acquire_proc_snapshot(&reader)->length;
+        release_proc_snapshot(&reader);
+    }
+    end_measure(&measure, "acquire_proc_snapshot+release_proc_snapshot", size, 1000000);
+
+    unregister_proc_reader(&reader);
+    destroy_proc_publisher(publisher);
+
+    ProcHistory *history = create_proc_history(8);
+    begin_measure(&measure);
+    record_proc_history(history, list);
+    end_measure(&measure, "record_proc_history/keyframe", size, size);
+
+    unsigned long long ticks = 0;
+    begin_measure(&measure);
+    for (unsigned int tick = 0; tick < 8; tick += 1) {
+        for (ProcessElementList *process = list->first; process != NULL; process = process->next) {
+            if (next_random() % 100 == 0) process->cpu_usage = (next_random() % 10000) / 100.0f;
+        }
+        record_proc_history(history, list);
+    }
+    end_measure(&measure, "record_proc_history/1%", size, 8ull * size);
+
+    unsigned long long first, last;
+    get_proc_history_ticks(history, &first, &last);
+    StartProcList *restored = malloc(sizeof(StartProcList));
+    init_proc_list_with_pool(restored, 0);
+    begin_measure(&measure);
+    restore_proc_history(history, last, restored);
+    end_measure(&measure, "restore_proc_history", size, size);
+    ticks += last;
+
+    clean_proc_list(restored);
+    destroy_proc_history(history);
+    if (total + ticks == 42) puts("#");
+    free(indexes);
+    clean_proc_list(list);
+}
+
+/*
+  * This function benchmarks the functions reading the live /proc (size is the process count).
+*/
+void bench_proc_functions(void) {
+    Measure measure;
+    StartProcList *list = malloc(sizeof(StartProcList));
+    init_proc_list_with_pool(list, 0);
+    scan_procs(list);
+    unsigned int size = list->length;
+
+    unsigned char masks[3] = {PROC_FIELD_ALL, PROC_FIELD_USER, 0};
+    const char *names[3] = {"scan_procs_fields/all", "scan_procs_fields/user", "scan_procs_fields/stat"};
+    for (unsigned int mask = 0; mask < 3; mask += 1) {
+        while (list->length) remove_proc(list, list->first);
+        begin_measure(&measure);
+        scan_procs_fields(list, masks[mask]);
+        end_measure(&measure, names[mask], size, list->length);
+    }
+
+    while (list->length) remove_proc(list, list->first);
+    begin_measure(&measure);
+    scan_procs(list);
+    end_measure(&measure, "scan_procs", size, list->length);
+
+    while (list->length) remove_proc(list, list->first);
+    begin_measure(&measure);
+    scan_procs_parallel(list, 0);
+    end_measure(&measure, "scan_procs_parallel", size, list->length);
+
+    ProcDiff diff;
+    init_proc_diff(&diff);
+    refresh_procs(list, &diff);
+    begin_measure(&measure);
+    refresh_procs(list, &diff);
+    end_measure(&measure, "refresh_procs", size, list->length);
+
+    char *(*getters[3])(StartProcList *, ProcessElementList *) = {get_proc_executable, get_proc_cmdline, get_proc_user};
+    const char *getter_names[3] = {"get_proc_executable/lazy", "get_proc_cmdline/lazy", "get_proc_user/lazy"};
+    for (unsigned int getter = 0; getter < 3; getter += 1) {
+        while (list->length) remove_proc(list, list->first);
+        scan_procs_fields(list, 0);
+        begin_measure(&measure);
+        for (ProcessElementList *process = list->first; process != NULL; process = process->next) getters[getter](list, process);
+        end_measure(&measure, getter_names[getter], size, list->length);
+    }
+
+    while (list->length) remove_proc(list, list->first);
+    scan_procs_fields(list, 0);
+    begin_measure(&measure);
+    for (ProcessElementList *process = list->first; process != NULL; process = process->next) load_proc_fields(list, process, PROC_FIELD_ALL);
+    end_measure(&measure, "load_proc_fields", size, list->length);
+
+    unsigned int threads = 0;
+    begin_measure(&measure);
+    for (ProcessElementList *process = list->first; process != NULL; process = process->next) load_proc_threads(list, process);
+    end_measure(&measure, "load_proc_threads", size, list->length);
+
+    begin_measure(&measure);
+    for (ProcessElementList *process = list->first; process != NULL; process = process->next) threads += count_proc_threads(process);
+    end_measure(&measure, "count_proc_threads", size, list->length);
+
+    begin_measure(&measure);
+    for (ProcessElementList *process = list->first; process != NULL; process = process->next) free_proc_threads(list, process);
+    end_measure(&measure, "free_proc_threads", size, list->length);
+
+    begin_measure(&measure);
+    for (unsigned int position = 0; position < 100000; position += 1) resolve_proc_user(list, position % 4 ? 0 : 65534);
+    end_measure(&measure, "resolve_proc_user", size, 100000);
+
+    begin_measure(&measure);
+    ProcEvents *events = open_proc_events();
+    end_measure(&measure, "open_proc_events", size, 1);
+
+    if (events != NULL) {
+        get_proc_events_fd(events);
+        begin_measure(&measure);
+        for (unsigned int position = 0; position < 1000; position += 1) apply_proc_events(list, events, &diff);
+        end_measure(&measure, "apply_proc_events/idle", size, 1000);
+
+        begin_measure(&measure);
+        close_proc_events(events);
+        end_measure(&measure, "close_proc_events", size, 1);
+    }
+
+    begin_measure(&measure);
+    clean_proc_diff(list, &diff);
+    end_measure(&measure, "clean_proc_diff", size, 1);
+    if (threads == 0) puts("# no thread found");
+    clean_proc_list(list);
+}
+
+/*
+  * This function benchmarks get_proc_pid with and without PID index.
+*/
+void bench_pid_index(void) {
+    unsigned int sizes[] = {1000, 10000, 100000};
+
+    for (unsigned int size_index = 0; size_index < 3; size_index += 1) {
+        unsigned int size = sizes[size_index];
+
+        for (char indexed = 0; indexed < 2; indexed += 1) {
+            StartProcList *list = malloc(sizeof(StartProcList));
+            init_proc_list(list);
+            if (indexed) enable_proc_pid_index(list);
+            for (unsigned int pid = 0; pid < size; pid += 1) add_proc(list, make_proc(pid * 7 + 1, 0));
+
+            unsigned int lookups = indexed ? 1000000 : 100000000 / size;
+            unsigned int found = 0;
+            srand(42);
+            double start = now_ns();
+            for (unsigned int count = 0; count < lookups; count += 1) {
+                found += get_proc_pid(list, (rand() % size) * 7 + 1) != NULL;
+            }
+            double elapsed = now_ns() - start;
+
+            printf("# get_proc_pid %-8s %7u entries: %10.1f ns/lookup (%u found)\n", indexed ? "index" : "linear", size, elapsed / lookups, found);
+            clean_proc_list(list);
+        }
+    }
+}
+
+/*
+  * This function benchmarks a list rebuild with calloc/free nodes and with the node pool
+  * (new_proc always uses the pool, the baseline nodes come from make_proc).
+*/
+void bench_pool(void) {
+    unsigned int size = 30000;
+
+    for (char pooled = 0; pooled < 2; pooled += 1) {
+        StartProcList *list = malloc(sizeof(StartProcList));
+        if (pooled) init_proc_list_with_pool(list, 0); else init_proc_list(list);
+
+        double start = now_ns();
+        for (unsigned int round = 0; round < 100; round += 1) {
+            for (unsigned int pid = 0; pid < size; pid += 1) {
+                ProcessElementList *process = pooled ? new_proc(list) : make_proc(pid, 0);
+                process->pid = pid;
+                add_proc(list, process);
+            }
+            while (list->length) remove_proc(list, list->first);
+        }
+        double elapsed = now_ns() - start;
+
+        printf("# rebuild %-6s %u entries: %10.1f ns/process\n", pooled ? "pool" : "calloc", size, elapsed / (100.0 * size));
+        clean_proc_list(list);
+    }
+}
+
+/*
+  * This function benchmarks full scans of the live /proc.
+*/
+void bench_scan(void) {
+    StartProcList *list = malloc(sizeof(StartProcList));
+    init_proc_list_with_pool(list, 0);
+
+    unsigned int scans = 0;
+    double start = now_ns();
+    double elapsed = 0;
+
+    while (elapsed < 1e9) {
+        while (list->length) remove_proc(list, list->first);
+        scan_procs(list);
+        scans += 1;
+        elapsed = now_ns() - start;
+    }
+
+    printf("# scan_procs %u processes: %.1f scans/s (%.0f ns/process)\n", list->length, scans / (elapsed / 1e9), elapsed / scans / list->length);
+    clean_proc_list(list);
+}
+
+/*
+  * This function benchmarks the parallel scan wall time against the thread count.
+*/
+void bench_parallel_scan(void) {
+    for (unsigned int threads = 1; threads <= 16; threads *= 2) {
+        StartProcList *list = malloc(sizeof(StartProcList));
+        init_proc_list_with_pool(list, 0);
+
+        unsigned int scans = 0;
+        double start = now_ns();
+        double elapsed = 0;
+
+        while (elapsed < 5e8) {
+            while (list->length) remove_proc(list, list->first);
+            scan_procs_parallel(list, threads);
+            scans += 1;
+            elapsed = now_ns() - start;
+        }
+
+        printf("# scan_procs_parallel %u processes, %u threads: %.0f us/scan\n", list->length, threads, elapsed / scans / 1e3);
+        clean_proc_list(list);
+    }
+}
+
+/*
+  * This function benchmarks scans without strings against full scans.
+*/
+void bench_lazy_fields(void) {
+    unsigned char masks[3] = {PROC_FIELD_ALL, PROC_FIELD_USER, 0};
+    const char *names[3] = {"all fields", "user only", "stat only"};
+
+    for (unsigned int mask = 0; mask < 3; mask += 1) {
+        StartProcList *list = malloc(sizeof(StartProcList));
+        init_proc_list_with_pool(list, 0);
+
+        unsigned int scans = 0;
+        double start = now_ns();
+        double elapsed = 0;
+
+        while (elapsed < 5e8) {
+            while (list->length) remove_proc(list, list->first);
+            scan_procs_fields(list, masks[mask]);
+            scans += 1;
+            elapsed = now_ns() - start;
+        }
+
+        printf("# scan_procs_fields %s %u processes: %.0f ns/process\n", names[mask], list->length, elapsed / scans / list->length);
+        clean_proc_list(list);
+    }
+}
+
+/*
+  * This function benchmarks the UID cache against getpwuid_r for 20000 processes.
+*/
+void bench_users(void) {
+    unsigned int size = 20000;
+    StartProcList *list = malloc(sizeof(StartProcList));
+    init_proc_list(list);
+
+    unsigned int uids[8];
+    unsigned int uid_count = 0;
+    setpwent();
+    for (struct passwd *entry = getpwent(); entry != NULL && uid_count < 8; entry = getpwent()) uids[uid_count++] = entry->pw_uid;
+    endpwent();
+
+    char buffer[1024];
+    struct passwd entry, *result;
+    unsigned long long length = 0;
+    unsigned long long start = now_ns();
+    for (unsigned int process = 0; process < size; process += 1) {
+        getpwuid_r(uids[process % uid_count], &entry, buffer, sizeof(buffer), &result);
+        length += result != NULL;
+    }
+    unsigned long long naive_time = now_ns() - start;
+
+    start = now_ns();
+    for (unsigned int process = 0; process < size; process += 1) length += resolve_proc_user(list, uids[process % uid_count]) != NULL;
+    unsigned long long cache_time = now_ns() - start;
+
+    printf("# user lookups %u processes, %u users: getpwuid_r %llu ns/process, cache %llu ns/process (%llu)\n", size, uid_count, naive_time / size, cache_time / size, length);
+    clean_proc_list(list);
+}
+
+/*
+  * This function benchmarks loading the threads of every process.
+*/
+void bench_threads(void) {
+    StartProcList *list = malloc(sizeof(StartProcList));
+    init_proc_list_with_pool(list, 0);
+    scan_procs(list);
+
+    unsigned int threads = 0;
+    unsigned long long start = now_ns();
+    for (ProcessElementList *process = list->first; process != NULL; process = process->next) {
+        load_proc_threads(list, process);
+        threads += count_proc_threads(process);
+    }
+    unsigned long long elapsed = now_ns() - start;
+
+    printf("# load_proc_threads %u processes, %u threads: %llu ns/thread, node %zu bytes, thread record %zu bytes\n", list->length, threads, elapsed / (threads ? threads : 1), sizeof(ProcessElementList), sizeof(ProcThread));
+    clean_proc_list(list);
+}
+
+/*
+  * This function benchmarks a steady state refresh against a full rebuild.
+*/
+void bench_refresh(void) {
+    for (char incremental = 0; incremental < 2; incremental += 1) {
+        StartProcList *list = malloc(sizeof(StartProcList));
+        init_proc_list_with_pool(list, 0);
+        ProcDiff diff;
+        init_proc_diff(&diff);
+        refresh_procs(list, &diff);
+
+        unsigned int rounds = 0;
+        double start = now_ns();
+        double elapsed = 0;
+
+        while (elapsed < 1e9) {
+            if (incremental) {
+                refresh_procs(list, &diff);
+            } else {
+                while (list->length) remove_proc(list, list->first);
+                scan_procs(list);
+            }
+            rounds += 1;
+            elapsed = now_ns() - start;
+        }
+
+        printf("# %-14s %u processes: %10.0f ns/round\n", incremental ? "refresh_procs" : "full rebuild", list->length, elapsed / rounds);
+        clean_proc_diff(list, &diff);
+        clean_proc_list(list);
+    }
+}
+
+/*
+  * This function benchmarks a snapshot column scan against a list traversal.
+*/
+void bench_snapshot(void) {
+    unsigned int size = 100000;
+    StartProcList *list = malloc(sizeof(StartProcList));
+    init_proc_list(list);
+
+    ProcessElementList **processes = malloc(size * sizeof(ProcessElementList *));
+    for (unsigned int pid = 0; pid < size; pid += 1) {
+        processes[pid] = make_proc(pid, 1);
+        processes[pid]->cpu_usage = rand() % 1000 / 10.0;
+    }
+    for (unsigned int position = size - 1; position > 0; position -= 1) {     // scattered nodes
+        unsigned int other = rand() % (position + 1);
+        ProcessElementList *process = processes[position];
+        processes[position] = processes[other];
+        processes[other] = process;
+    }
+    for (unsigned int pid = 0; pid < size; pid += 1) add_proc(list, processes[pid]);
+
+    ProcSnapshot snapshot;
+    double start = now_ns();
+    export_proc_snapshot(list, &snapshot);
+    printf("# export_proc_snapshot %u entries: %.0f ns\n", size, now_ns() - start);
+
+    double list_sum = 0, snapshot_sum = 0;
+    unsigned int list_count = 0, snapshot_count = 0;
+    unsigned int *indexes = malloc(size * sizeof(unsigned int));
+
+    start = now_ns();
+    for (unsigned int round = 0; round < 100; round += 1) {
+        for (ProcessElementList *process = list->first; process != NULL; process = process->next) {
+            list_sum += process->cpu_usage;
+            list_count += process->cpu_usage > 50;
+        }
+    }
+    double list_time = (now_ns() - start) / 100;
+
+    start = now_ns();
+    for (unsigned int round = 0; round < 100; round += 1) {
+        snapshot_sum += sum_snapshot_values(snapshot.cpu, snapshot.length);
+        snapshot_count += filter_snapshot_values(snapshot.cpu, snapshot.length, 50, indexes);
+    }
+    double snapshot_time = (now_ns() - start) / 100;
+
+    printf("# sum+filter %u entries: list %.0f ns, snapshot %.0f ns (x%.1f, %u/%u matches)\n", size, list_time, snapshot_time, list_time / snapshot_time, list_count / 100, snapshot_count / 100);
+    free(indexes);
+    free(processes);
+    free_proc_snapshot(&snapshot);
+    clean_proc_list(list);
+}
+
+/*
+  * This function benchmarks random positional access with and without the positional index.
+*/
+void bench_positions(void) {
+    unsigned int size = 100000;
+
+    for (char indexed = 0; indexed < 2; indexed += 1) {
+        StartProcList *list = malloc(sizeof(StartProcList));
+        init_proc_list_with_pool(list, 0);
+        for (unsigned int pid = 0; pid < size; pid += 1) {
+            ProcessElementList *process = new_proc(list);
+            process->pid = pid;
+            add_proc(list, process);
+        }
+        if (indexed) enable_proc_positions(list);
+
+        unsigned int operations = indexed ? 100000 : 2000;
+        unsigned long long checksum = 0;
+        srand(42);
+        double start = now_ns();
+        for (unsigned int operation = 0; operation < operations; operation += 1) {
+            checksum += get_proc(list, rand() % size)->pid;
+        }
+        double get_time = (now_ns() - start) / operations;
+
+        start = now_ns();
+        for (unsigned int operation = 0; operation < operations; operation += 1) {
+            ProcessElementList *process = new_proc(list);
+            insert_proc(list, process, rand() % size);
+            remove_proc_index(list, rand() % size);
+        }
+        double update_time = (now_ns() - start) / operations;
+
+        printf("# %-10s %u entries: get_proc %10.1f ns, insert_proc+remove_proc_index %10.1f ns (%llu)\n", indexed ? "positions" : "walk", size, get_time, update_time, checksum % 10);
+        clean_proc_list(list);
+    }
+}
+
+/*
+  * This function benchmarks a full view sort against incremental view maintenance.
+*/
+void bench_view(void) {
+    unsigned int size = 30000;
+    StartProcList *list = malloc(sizeof(StartProcList));
+    init_proc_list_with_pool(list, 0);
+    enable_proc_positions(list);
+    srand(42);
+
+    for (unsigned int pid = 0; pid < size; pid += 1) {
+        ProcessElementList *process = new_proc(list);
+        process->pid = pid;
+        process->cpu_usage = rand() % 10000 / 100.0;
+        add_proc(list, process);
+    }
+
+    ProcSortedView view;
+    init_proc_view(&view, list, compare_proc_cpu_usage);
+
+    for (unsigned int changes = 100; changes <= 1000; changes *= 10) {
+        double sort_time = 0, update_time = 0;
+
+        for (unsigned int round = 0; round < 20; round += 1) {
+            for (unsigned int change = 0; change < changes; change += 1) get_proc(list, rand() % size)->cpu_usage = rand() % 10000 / 100.0;
+
+            double start = now_ns();
+            update_proc_view(&view, NULL);
+            update_time += now_ns() - start;
+
+            ProcSortedView full;
+            start = now_ns();
+            init_proc_view(&full, list, compare_proc_cpu_usage);
+            sort_time += now_ns() - start;
+            free_proc_view(&full);
+        }
+
+        printf("# top view %u entries, %4u changes: full sort %8.0f ns, update_proc_view %8.0f ns\n", size, changes, sort_time / 20, update_time / 20);
+    }
+
+    free_proc_view(&view);
+    clean_proc_list(list);
+}
+
+/*
+  * This function benchmarks binary snapshot files write and mapped load.
+*/
+void bench_snapshot_file(void) {
+    unsigned int size = 30000;
+    StartProcList *list = malloc(sizeof(StartProcList));
+    init_proc_list_with_pool(list, 0);
+    char cmdline[64];
+
+    for (unsigned int pid = 0; pid < size; pid += 1) {
+        ProcessElementList *process = new_proc(list);
+        process->pid = pid;
+        snprintf(cmdline, sizeof(cmdline), "/usr/bin/python3 worker.py --id %u", pid % 1000);
+        set_proc_strings(list, process, "/usr/bin/python3", cmdline, "www-data");
+        add_proc(list, process);
+    }
+
+    char path[] = "/tmp/proclist_bench_snapshot.bin";
+    double start = now_ns();
+    write_proc_snapshot_file(list, path);
+    double write_time = now_ns() - start;
+
+    ProcSnapshotFile file;
+    unsigned long long checksum = 0;
+    start = now_ns();
+    for (unsigned int round = 0; round < 100; round += 1) {
+        open_proc_snapshot_file(&file, path);
+        checksum += get_proc_record(&file, round)->pid;
+        close_proc_snapshot_file(&file);
+    }
+    double load_time = (now_ns() - start) / 100;
+
+    printf("# snapshot file %u entries: write %.0f ns, open+read %.0f ns (%llu)\n", size, write_time, load_time, checksum);
+    remove(path);
+    clean_proc_list(list);
+}
+
+/*
+  * This function benchmarks history recording and restoring (10000 processes, 1% churn per tick).
+*/
+void bench_history(void) {
+    unsigned int ticks = 64;
+    ProcHistory *history = create_proc_history(ticks);
+    StartProcList **lists = malloc(ticks * sizeof(StartProcList *));
+
+    for (unsigned int tick = 0; tick < ticks; tick += 1) {
+        lists[tick] = malloc(sizeof(StartProcList));
+        init_proc_list_with_pool(lists[tick], 0);
+        fill_history_tick(lists[tick], tick, 10000);
+    }
+
+    unsigned long long start = now_ns();
+    for (unsigned int tick = 0; tick < ticks; tick += 1) record_proc_history(history, lists[tick]);
+    unsigned long long record_time = now_ns() - start;
+
+    StartProcList *restored = malloc(sizeof(StartProcList));
+    init_proc_list(restored);
+    start = now_ns();
+    restore_proc_history(history, ticks - 1, restored);
+    unsigned long long restore_time = now_ns() - start;
+
+    printf("# history: record %llu ns/tick, restore last of %u ticks %llu ns\n", record_time / ticks, ticks, restore_time);
+
+    clean_proc_list(restored);
+    for (unsigned int tick = 0; tick < ticks; tick += 1) clean_proc_list(lists[tick]);
+    free(lists);
+    destroy_proc_history(history);
+}
+
+/*
+  * This function benchmarks add_proc against add_procs and splice_proc_list (1000000 processes).
+*/
+void bench_batch(void) {
+    unsigned int size = 1000000;
+    ProcessElementList **processes = malloc(size * sizeof(ProcessElementList *));
+    for (unsigned int pid = 0; pid < size; pid += 1) processes[pid] = make_proc(pid, 0);
+
+    StartProcList list;
+    init_proc_list(&list);
+    unsigned long long start = now_ns();
+    for (unsigned int pid = 0; pid < size; pid += 1) add_proc(&list, processes[pid]);
+    unsigned long long single_time = now_ns() - start;
+
+    init_proc_list(&list);
+    start = now_ns();
+    add_procs(&list, processes, size);
+    unsigned long long batch_time = now_ns() - start;
+
+    StartProcList shards[8];
+    for (unsigned int shard = 0; shard < 8; shard += 1) {
+        init_proc_list(&shards[shard]);
+        add_procs(&shards[shard], processes + shard * (size / 8), size / 8);
+    }
+
+    init_proc_list(&list);
+    start = now_ns();
+    for (unsigned int shard = 0; shard < 8; shard += 1) splice_proc_list(&list, &shards[shard], list.last);
+    unsigned long long splice_time = now_ns() - start;
+
+    printf("# batch %u processes: add_proc %llu ns, add_procs %llu ns, 8 shards splice %llu ns\n", size, single_time, batch_time, splice_time);
+
+    for (unsigned int pid = 0; pid < size; pid += 1) free(processes[pid]);
+    free(processes);
+}
+
+/*
+  * This function benchmarks keeping a list fresh with events against refresh_procs (100 short-lived children).
+*/
+void bench_events(void) {
+    ProcEvents *events = open_proc_events();
+    if (events == NULL) {
+        puts("# events: process connector is not available");
+        return;
+    }
+
+    StartProcList *list = malloc(sizeof(StartProcList));
+    init_proc_list_with_pool(list, 0);
+    ProcDiff diff;
+    init_proc_diff(&diff);
+    refresh_procs(list, &diff);
+
+    unsigned long long events_time = 0, refresh_time = 0, start;
+    unsigned int seen = 0;
+    for (unsigned int child = 0; child < 100; child += 1) {
+        pid_t pid = fork();
+        if (pid == 0) _exit(0);
+        waitpid(pid, NULL, 0);
+
+        start = now_ns();
+        apply_proc_events(list, events, &diff);
+        events_time += now_ns() - start;
+        seen += contains_proc(diff.exited, diff.exited_length, pid);
+
+        start = now_ns();
+        refresh_procs(list, &diff);
+        refresh_time += now_ns() - start;
+    }
+
+    printf("# events: apply_proc_events %llu ns/child (%u of 100 short-lived children seen), refresh_procs %llu ns/child\n", events_time / 100, seen, refresh_time / 100);
+    close_proc_events(events);
+    clean_proc_diff(list, &diff);
+    clean_proc_list(list);
+}
+
+/*
+  * This function benchmarks search_procs with and without the trigram index
+  * on long Java like command lines (about 1 KB).
+*/
+void bench_trigrams(void) {
+    static const char *jars[] = {"kafka-clients", "jackson-databind", "netty-handler", "guava", "slf4j-api", "logback-classic", "commons-lang3", "snappy-java", "zstd-jni", "lz4-java", "protobuf-java", "grpc-core"};
+    static const char *searches[] = {"--instance 73219", "snappy-java-1.1.7", "-Xmx2048m -Dservice=billing", "org.example.Main", "no-such-option"};
+    unsigned int size = 100000, repeat = 20;
+    char cmdline[1536];
+
+    StartProcList *list = malloc(sizeof(StartProcList));
+    init_proc_list_with_pool(list, 0);
+
+    for (unsigned int pid = 1; pid <= size; pid += 1) {
+        int length = snprintf(cmdline, sizeof(cmdline), "/usr/lib/jvm/java-17/bin/java -Xmx%um -Dservice=%s -cp", 512u << (next_random() % 4), next_random() % 2 ? "billing" : "search");
+        while (length < 960) {
+            const char *jar = jars[next_random() % (sizeof(jars) / sizeof(jars[0]))];
+            length += snprintf(cmdline + length, sizeof(cmdline) - length, "%c/opt/app/lib/%s-%u.%u.%u.jar", length % 7 ? ':' : ' ', jar, next_random() % 3, next_random() % 20, next_random() % 10);
+        }
+        snprintf(cmdline + length, sizeof(cmdline) - length, " org.example.Main --instance %u", pid);
+
+        ProcessElementList *process = new_proc(list);
+        process->pid = pid;
+        set_proc_strings(list, process, "/usr/lib/jvm/java-17/bin/java", cmdline, "app");
+        add_proc(list, process);
+    }
+
+    unsigned long long linear_time[5], index_time[5];
+    unsigned int counts[5];
+    for (unsigned int search = 0; search < 5; search += 1) {
+        unsigned long long start = now_ns();
+        for (unsigned int round = 0; round < repeat; round += 1) counts[search] = search_procs(list, searches[search], NULL, 0);
+        linear_time[search] = (now_ns() - start) / repeat;
+    }
+
+    unsigned long long start = now_ns();
+    enable_proc_trigrams(list);
+    unsigned long long build_time = now_ns() - start;
+
+    for (unsigned int search = 0; search < 5; search += 1) {
+        start = now_ns();
+        for (unsigned int round = 0; round < repeat; round += 1) {
+            if (search_procs(list, searches[search], NULL, 0) != counts[search]) puts("# trigrams: index and linear search differ");
+        }
+        index_time[search] = (now_ns() - start) / repeat;
+    }
+
+    start = now_ns();
+    unsigned int updates = 0;
+    for (ProcessElementList *process = list->first; process != NULL && updates < 10000; process = process->next, updates += 1) {
+        set_proc_strings(list, process, process->executable, process->cmdline, process->user);
+    }
+    unsigned long long update_time = now_ns() - start;
+
+    printf("# trigrams %u processes, 1 KB cmdlines: enable_proc_trigrams %llu ms, reindex %llu ns/process\n", size, build_time / 1000000, update_time / updates);
+    for (unsigned int search = 0; search < 5; search += 1) {
+        printf("# search_procs \"%s\" %u matches: linear %llu us, trigram index %llu us\n", searches[search], counts[search], linear_time[search] / 1000, index_time[search] / 1000);
+    }
+
+    clean_proc_list(list);
+}
+
+/*
+  * This function benchmarks a compiled query against the equivalent hand-written loop.
+*/
+void bench_query(void) {
+    unsigned int size = 1000000;
+    StartProcList *list = build_list(size);
+    const char *expression = "cmdline contains \"--queue 5 \" && user == \"postgres\" && cpu_usage > 5";
+
+    unsigned long long start = now_ns();
+    ProcQuery *query = compile_proc_query(expression);
+    unsigned long long compile_time = now_ns() - start;
+
+    unsigned int hand_matches = 0;
+    start = now_ns();
+    for (ProcessElementList *process = list->first; process != NULL; process = process->next) {
+        hand_matches += strcmp(process->user, "postgres") == 0 && process->cpu_usage > 5 && strstr(process->cmdline, "--queue 5 ") != NULL;
+    }
+    unsigned long long hand_time = now_ns() - start;
+
+    start = now_ns();
+    unsigned int query_matches = select_proc_query(list, query, NULL, 0);
+    unsigned long long query_time = now_ns() - start;
+
+    ProcIterator iterator;
+    unsigned int iterator_matches = 0;
+    init_proc_iterator(list, &iterator);
+    set_proc_iterator_filter(&iterator, match_proc_query, query);
+    start = now_ns();
+    while (get_next_iterator_proc(&iterator) != NULL) iterator_matches += 1;
+    unsigned long long iterator_time = now_ns() - start;
+
+    printf("# query %u processes, %u matches: compile %llu ns, hand-written loop %.2f ns/process, select_proc_query %.2f ns/process, filtered iterator %.2f ns/process (%u %u)\n", size, query_matches, compile_time, (double)hand_time / size, (double)query_time / size, (double)iterator_time / size, hand_matches, iterator_matches);
+    free_proc_query(query);
+    clean_proc_list(list);
+}
+
+/*
+  * This function benchmarks the compact list functions on size processes.
+*/
+void bench_compact_functions(unsigned int size) {
+    Measure measure;
+    StartProcList *list = build_list(size);
+    ProcCompactList compact;
+    unsigned int *nodes = malloc(size * sizeof(unsigned int));
+    unsigned int total = 0;
+
+    begin_measure(&measure);
+    init_proc_compact(&compact);
+    end_measure(&measure, "init_proc_compact", size, 1);
+
+    begin_measure(&measure);
+    compact_proc_list(&compact, list);
+    end_measure(&measure, "compact_proc_list", size, size);
+
+    begin_measure(&measure);
+    for (unsigned int position = 0; position < size; position += 1) nodes[position] = get_proc_compact_pid(&compact, next_random() % size + 1);
+    end_measure(&measure, "get_proc_compact_pid", size, size);
+
+    begin_measure(&measure);
+    for (unsigned int position = 0; position < size; position += 1) total += get_proc_compact_string(&compact, compact.nodes[nodes[position]].cmdline) != NULL;
+    end_measure(&measure, "get_proc_compact_string", size, size);
+
+    begin_measure(&measure);
+    for (unsigned int position = 0; position < size; position += 1) set_proc_compact_strings(&compact, nodes[position], "/usr/bin/python3", "python3 worker.py", "www-data");
+    end_measure(&measure, "set_proc_compact_strings", size, size);
+
+    StartProcList *expanded = malloc(sizeof(StartProcList));
+    init_proc_list_with_pool(expanded, 0);
+    begin_measure(&measure);
+    expand_proc_compact(&compact, expanded);
+    end_measure(&measure, "expand_proc_compact", size, size);
+
+    begin_measure(&measure);
+    for (unsigned int pid = 1; pid <= size; pid += 1) remove_proc_compact(&compact, get_proc_compact_pid(&compact, pid));
+    end_measure(&measure, "remove_proc_compact", size, size);
+
+    begin_measure(&measure);
+    for (unsigned int pid = 1; pid <= size; pid += 1) total += new_proc_compact(&compact, pid) != PROC_COMPACT_NONE;
+    end_measure(&measure, "new_proc_compact", size, size);
+
+    begin_measure(&measure);
+    free_proc_compact(&compact);
+    end_measure(&measure, "free_proc_compact", size, 1);
+
+    free(nodes);
+    clean_proc_list(expanded);
+    clean_proc_list(list);
+    if (total == 0) puts("# no compact node");
+}
+
+/*
+  * This function benchmarks the node size and a traversal of the list and of the compact list.
+*/
+void bench_compact(void) {
+    unsigned int size = 1000000, repeat = 10;
+    StartProcList *list = build_list(size);
+    ProcCompactList compact;
+    init_proc_compact(&compact);
+
+    unsigned long long start = now_ns();
+    compact_proc_list(&compact, list);
+    unsigned long long convert_time = now_ns() - start;
+
+    double list_sum = 0, compact_sum = 0;
+    start = now_ns();
+    for (unsigned int round = 0; round < repeat; round += 1) {
+        for (ProcessElementList *process = list->first; process != NULL; process = process->next) list_sum += process->cpu_usage + process->pid;
+    }
+    unsigned long long list_time = (now_ns() - start) / repeat;
+
+    start = now_ns();
+    for (unsigned int round = 0; round < repeat; round += 1) {
+        for (unsigned int node = compact.first; node != PROC_COMPACT_NONE; node = compact.nodes[node].next) compact_sum += compact.nodes[node].cpu_usage + compact.nodes[node].pid;
+    }
+    unsigned long long compact_time = (now_ns() - start) / repeat;
+
+    printf("# compact %u processes: node %zu bytes, compact node %zu bytes, compact_proc_list %llu ns/process, traversal list %.2f ns/process, compact %.2f ns/process (%d)\n", size, sizeof(ProcessElementList), sizeof(ProcCompactNode), convert_time / size, (double)list_time / size, (double)compact_time / size, list_sum == compact_sum);
+    free_proc_compact(&compact);
+    clean_proc_list(list);
+}
+
+/*
+  * Main function to benchmark my process list.
+*/
+int main(int argc, char *argv[]) {
+    unsigned int maximum_size = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+    open_perf_counters();
+
+    puts("function,size,operations,ns_per_op,ops_per_s,allocations_per_op,cycles_per_op,cache_misses_per_op");
+    for (unsigned int size = 100; size <= maximum_size; size *= 10) {
+        bench_list_functions(size);
+        bench_memory_functions(size);
+        bench_order_functions(size);
+        bench_snapshot_functions(size);
+        bench_compact_functions(size);
+    }
+
+    bench_proc_functions();
+
+    bench_pid_index();
+    bench_pool();
+    bench_scan();
+    bench_parallel_scan();
+    bench_lazy_fields();
+    bench_users();
+    bench_threads();
+    bench_refresh();
+    bench_snapshot();
+    bench_positions();
+    bench_view();
+    bench_snapshot_file();
+    bench_history();
+    bench_batch();
+    bench_events();
+    bench_query();
+    bench_trigrams();
+    bench_compact();
+    return 0;
+}
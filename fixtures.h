@@ -0,0 +1,82 @@
+/* fixtures.h */
+
+/*
+    Copyright (C) 2023  Maurice Lambert
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*
+    Process and list helpers shared by tests.c and bench.c,
+    included once by each program after proclist.h.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+
+/*
+  * This function allocates a process with only PIDs defined (calloc, not from a pool).
+*/
+ProcessElementList *make_proc(unsigned int pid, unsigned int ppid) {
+    ProcessElementList *process = calloc(1, sizeof(ProcessElementList));
+    if (process == NULL) return NULL;
+    process->pid = pid;
+    process->ppid = ppid;
+    return process;
+}
+
+/*
+  * This function returns a monotonic time in nanoseconds.
+*/
+double now_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1e9 + now.tv_nsec;
+}
+
+/*
+  * This function returns 1 if a process is in an array.
+*/
+char contains_proc(ProcessElementList **processes, unsigned int length, unsigned int pid) {
+    for (unsigned int position = 0; position < length; position += 1) {
+        if (processes[position]->pid == pid) return 1;
+    }
+    return 0;
+}
+
+/*
+  * This function keeps processes with an even PID (ProcFilter).
+*/
+char even_pid_filter(ProcessElementList *process, void *data) {
+    (void)data;
+    return process->pid % 2 == 0;
+}
+
+/*
+  * This function fills a list with the processes of a simulated tick:
+  * 10 processes exit and 10 start per tick, some usages change
+  * and the PID 1 is reused every 3 ticks.
+*/
+void fill_history_tick(StartProcList *list, unsigned int tick, unsigned int size) {
+    char cmdline[32];
+
+    for (unsigned int pid = tick * 10 + 1; pid <= tick * 10 + size; pid += 1) {
+        ProcessElementList *process = new_proc(list);
+        process->pid = pid == tick * 10 + 1 ? 1 : pid;
+        process->ppid = 1;
+        process->start_timestamp = pid == tick * 10 + 1 ? tick / 3 : pid;
+        process->cpu_usage = pid % 5 ? pid % 7 : (pid * tick) % 7;
+        snprintf(cmdline, sizeof(cmdline), "worker --id %u", process->pid);
+        set_proc_strings(list, process, "worker", cmdline, "daemon");
+        add_proc(list, process);
+    }
+}
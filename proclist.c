@@ -17,248 +17,5431 @@
 #include  "proclist.h"
 #include <stddef.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pwd.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <errno.h>
+#include <linux/netlink.h>
+#include <linux/connector.h>
+#include <linux/cn_proc.h>
+
+#define PID_INDEX_MINIMUM_SIZE 64
+#define POOL_DEFAULT_CHUNK_SIZE 256
+#define POOL_MAXIMUM_CHUNK_SIZE 65536
+#define POOL_CHUNK_HEADER_SIZE ((sizeof(PoolChunk) + 15) & ~(size_t)15)
+#define STRINGS_MINIMUM_SIZE 256
+#define POSITIONS_MINIMUM_CHUNK 32
+#define POSITIONS_WALK_COST 32           // a node hop costs about as much as summing 32 chunk counts
+#define SCANNER_BUFFER_SIZE 4096
+#define SCANNER_LINK_SIZE 4096
+#define SCANNER_USER_SIZE 1024
+#define USERS_MINIMUM_SIZE 64
+#define EVENTS_BUFFER_SIZE 16384
+#define TRIGRAM_BUCKETS 65536            // hashed trigrams, collisions only add candidates
+#define TRIGRAM_MINIMUM_REMOVED 1024     // removed ids before the postings are compacted
+#define QUERY_MAXIMUM_DEPTH 256          // nested ! and ( in a query, the parser is recursive
+#define COMPACT_MINIMUM_RELEASED 4096    // released string bytes before the compact string blob is packed
+
+typedef struct UserEntry {
+    unsigned int uid;
+    char *name;                      // NULL: empty slot, decimal UID for unknown users
+    char *interned;                  // name interned in the list table (one reference held), NULL: not yet
+} UserEntry;
+
+typedef struct PidIndexSlot {
+    unsigned int pid;
+    ProcessElementList *element;     // NULL: empty slot
+} PidIndexSlot;
+
+struct ProcPidIndex {
+    unsigned int length;
+    unsigned int size;               // always a power of two
+    unsigned int shift;              // 32 - log2(size), used by the multiplicative hash
+    PidIndexSlot *slots;
+};
 
 /*
-  * This function initializes the process list.
+  * This function returns the home slot of a PID (Fibonacci hashing).
 */
-void init_proc_list(StartProcList *list) {
-    list->length = 0;
-    list->first = NULL;
-    list->last = NULL;
-    list->position = NULL;
-};
+static unsigned int hash_pid(ProcPidIndex *index, unsigned int pid) {
+    return (unsigned int)(pid * 2654435761u) >> index->shift;
+}
 
 /*
-  * This function free each processus and free the StartProcList memory.
+  * This function allocates the slots of the PID index.
+  * This function returns 1 if malloc failed.
 */
-void clean_proc_list(StartProcList *list) {
-    ProcessElementList *element = list->first;
-    ProcessElementList *new_element;
+static char allocate_pid_index(ProcPidIndex *index, unsigned int size) {
+    PidIndexSlot *slots = calloc(size, sizeof(PidIndexSlot));
+    if (slots == NULL) return 1;
 
-    while (element != NULL) {
-        new_element = element->next;
-        free(element);
-        element = new_element;
+    unsigned int shift = 32;
+    for (unsigned int value = size; value > 1; value >>= 1) shift -= 1;
+
+    index->slots = slots;
+    index->size = size;
+    index->shift = shift;
+    index->length = 0;
+    return 0;
+}
+
+/*
+  * This function adds or replaces a process in the PID index (no resize).
+*/
+static void put_pid_index(ProcPidIndex *index, ProcessElementList *element) {
+    unsigned int mask = index->size - 1;
+    unsigned int slot = hash_pid(index, element->pid);
+
+    while (index->slots[slot].element != NULL) {
+        if (index->slots[slot].pid == element->pid) {
+            index->slots[slot].element = element;
+            return;
+        }
+        slot = (slot + 1) & mask;
     }
 
-    free(list);
+    index->slots[slot].pid = element->pid;
+    index->slots[slot].element = element;
+    index->length += 1;
 }
 
 /*
-  * This function adds a process in the list.
+  * This function doubles the PID index size and re-inserts each process.
+  * This function returns 1 if malloc failed.
 */
-void add_proc(StartProcList *list, ProcessElementList *element) {
-    if (list->last == NULL) {
-        list->first = element;
-        list->position = element;
-    } else {
-        list->last->next = element;
-        element->precedent = list->last;
+static char grow_pid_index(ProcPidIndex *index) {
+    PidIndexSlot *old_slots = index->slots;
+    unsigned int old_size = index->size;
+
+    if (allocate_pid_index(index, old_size * 2)) {
+        index->slots = old_slots;
+        return 1;
     }
-    
-    list->length += 1;
-    list->last = element;
+
+    for (unsigned int slot = 0; slot < old_size; slot += 1) {
+        if (old_slots[slot].element != NULL) put_pid_index(index, old_slots[slot].element);
+    }
+
+    free(old_slots);
+    return 0;
 }
 
 /*
-  * This function returns and delete the last process.
-  * This function returns NULL if last element is not defined.
+  * This function adds a process in the list PID index, if enabled.
+  * When the index cannot grow it is dropped and get_proc_pid walks the list again.
 */
-ProcessElementList *pop_proc(StartProcList *list) {
-    if (list->last == NULL) {
-        return NULL;
+static void index_proc(StartProcList *list, ProcessElementList *element) {
+    ProcPidIndex *index = list->index;
+    if (index == NULL) return;
+
+    if ((index->length + 1) * 2 > index->size && grow_pid_index(index)) {
+        free(index->slots);
+        free(index);
+        list->index = NULL;
+        return;
     }
-    ProcessElementList *last = list->last;
-    list->last = last->precedent;
-    list->last->next = NULL;
-    list->length -= 1;
-    return last;
+
+    put_pid_index(index, element);
 }
 
 /*
-  * This function returns and delete the first process.
-  * This function returns NULL if the first process is not defined.
+  * This function removes a process from the list PID index, if enabled.
+  * Linear probing without tombstones: following slots are shifted back.
 */
-ProcessElementList *popleft_proc(StartProcList *list) {
-    if (list->first == NULL) {
-        return NULL;
+static void unindex_proc(StartProcList *list, ProcessElementList *element) {
+    ProcPidIndex *index = list->index;
+    if (index == NULL) return;
+
+    unsigned int mask = index->size - 1;
+    unsigned int slot = hash_pid(index, element->pid);
+
+    while (index->slots[slot].element != element) {
+        if (index->slots[slot].element == NULL) return;
+        slot = (slot + 1) & mask;
     }
-    
-    ProcessElementList *first = list->first;
-    list->first = first->next;
-    list->first->precedent = NULL;
-    list->length -= 1;
-    return first;
+
+    unsigned int next = slot;
+    for (;;) {
+        next = (next + 1) & mask;
+        if (index->slots[next].element == NULL) break;
+
+        unsigned int home = hash_pid(index, index->slots[next].pid);
+        if ((slot <= next) ? (slot < home && home <= next) : (slot < home || home <= next)) continue;
+
+        index->slots[slot] = index->slots[next];
+        slot = next;
+    }
+
+    index->slots[slot].element = NULL;
+    index->length -= 1;
 }
 
+typedef struct PoolChunk {
+    struct PoolChunk *next;
+    char *end;
+} PoolChunk;
+
+typedef struct PoolRun {
+    struct PoolRun *next;
+    char *end;                       // contiguous free items up to end, stored in the first item
+} PoolRun;
+
+struct ProcPool {
+    size_t item_size;
+    unsigned int chunk_size;         // items in the next chunk, doubled up to POOL_MAXIMUM_CHUNK_SIZE
+    PoolChunk *chunks;               // newest chunk first
+    PoolChunk *oldest;               // last chunk, adopted chunks are linked after the newest in O(1)
+    char *cursor;                    // next never used item in the newest chunk
+    PoolRun *free_items;             // released items (and adopted unused chunk ends), by runs
+    PoolRun *last_free;              // last run, valid when free_items is not NULL
+    unsigned int references;         // lists using the pool (split_proc_list, splice_proc_list)
+};
+
 /*
-  * This function inserts a process in specific position.
-  * Return 1 if index is greater than list length.
+  * This function creates a pool of fixed size items allocated in contiguous chunks.
+  * This function returns NULL if malloc failed.
 */
-char insert_proc(StartProcList *list, ProcessElementList *new_element, unsigned int index) {
-    if (index > list->length) {
-        return 1;
-    } else if (index == list->length) {
-        add_proc(list, new_element);
-    } else {
-        ProcessElementList *element = list->first;
-        for (unsigned int position = 0; index > position; position += 1) element = element->next;
+static ProcPool *create_pool(size_t item_size, unsigned int chunk_size) {
+    ProcPool *pool = malloc(sizeof(ProcPool));
+    if (pool == NULL) return NULL;
 
-        if (element->precedent != NULL) {
-            element->precedent->next = new_element;
-            new_element->precedent = element->precedent;
+    pool->item_size = (item_size + 15) & ~(size_t)15;
+    pool->chunk_size = chunk_size ? chunk_size : POOL_DEFAULT_CHUNK_SIZE;
+    pool->chunks = NULL;
+    pool->oldest = NULL;
+    pool->cursor = NULL;
+    pool->free_items = NULL;
+    pool->last_free = NULL;
+    pool->references = 1;
+    return pool;
+}
+
+/*
+  * This function frees all chunks of a pool and the pool itself
+  * when it is not used by another list.
+*/
+static void destroy_pool(ProcPool *pool) {
+    if (--pool->references) return;
+    PoolChunk *chunk = pool->chunks;
+
+    while (chunk != NULL) {
+        PoolChunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+
+    free(pool);
+}
+
+/*
+  * This function returns a zeroed item from the pool free list or newest chunk.
+  * This function returns NULL if malloc failed.
+*/
+static void *allocate_pool_item(ProcPool *pool) {
+    void *item = pool->free_items;
+
+    if (item != NULL) {
+        PoolRun *run = item;
+
+        if ((char *)item + pool->item_size < run->end) {
+            PoolRun *rest = (PoolRun *)((char *)item + pool->item_size);
+            rest->next = run->next;
+            rest->end = run->end;
+            if (pool->last_free == run) pool->last_free = rest;
+            pool->free_items = rest;
         } else {
-        	list->first = new_element;
+            pool->free_items = run->next;
         }
+    } else {
+        if (pool->chunks == NULL || pool->cursor == pool->chunks->end) {
+            PoolChunk *chunk = malloc(POOL_CHUNK_HEADER_SIZE + pool->chunk_size * pool->item_size);
+            if (chunk == NULL) return NULL;
 
-        element->precedent = new_element;
-        new_element->next = element;
-        list->length += 1;
+            pool->cursor = (char *)chunk + POOL_CHUNK_HEADER_SIZE;
+            chunk->end = pool->cursor + pool->chunk_size * pool->item_size;
+            chunk->next = pool->chunks;
+            pool->chunks = chunk;
+            if (chunk->next == NULL) pool->oldest = chunk;
+
+            if (pool->chunk_size < POOL_MAXIMUM_CHUNK_SIZE) pool->chunk_size *= 2;
+        }
+
+        item = pool->cursor;
+        pool->cursor += pool->item_size;
     }
-    
+
+    memset(item, 0, pool->item_size);
+    return item;
+}
+
+/*
+  * This function returns 1 if the item has been allocated by the pool.
+  * Chunks grow geometrically, there are O(log n) chunks to check.
+*/
+static char pool_owns(ProcPool *pool, void *item) {
+    for (PoolChunk *chunk = pool->chunks; chunk != NULL; chunk = chunk->next) {
+        if ((char *)item >= (char *)chunk + POOL_CHUNK_HEADER_SIZE && (char *)item < chunk->end) return 1;
+    }
+
     return 0;
 }
 
 /*
-  * This function inserts a process after a specific process.
+  * This function pushes an item on the pool free list.
 */
-void insert_after_proc(StartProcList *list, ProcessElementList *new_element, ProcessElementList *before) {
-    new_element->next = before->next;
-    new_element->precedent = before;
-    
-    if (before->next != NULL) {
-        before->next->precedent = new_element;
+static void release_pool_item(ProcPool *pool, void *item) {
+    PoolRun *run = item;
+    run->next = pool->free_items;
+    run->end = (char *)item + pool->item_size;
+    if (pool->free_items == NULL) pool->last_free = run;
+    pool->free_items = run;
+}
+
+typedef struct InternedString {
+    struct InternedString *next;
+    unsigned int hash;
+    unsigned int references;
+    char value[];
+} InternedString;
+
+struct ProcStrings {
+    unsigned int length;
+    unsigned int size;               // bucket count, always a power of two
+    InternedString **buckets;
+    unsigned int references;         // lists using the table (split_proc_list, splice_proc_list)
+};
+
+/*
+  * This function returns the FNV-1a hash of a string.
+*/
+static unsigned int hash_string(const char *value, size_t length) {
+    unsigned int hash = 2166136261u;
+
+    for (size_t position = 0; position < length; position += 1) {
+        hash ^= (unsigned char)value[position];
+        hash *= 16777619u;
     }
 
-    before->next = new_element;
-    list->length += 1;
+    return hash;
 }
 
 /*
-  * This function inserts a process before a specific process.
+  * This function creates an empty string intern table.
+  * This function returns NULL if malloc failed.
 */
-void insert_before_proc(StartProcList *list, ProcessElementList *new_element, ProcessElementList *after) {
-    new_element->precedent = after->precedent;
-    new_element->next = after;
+static ProcStrings *create_strings(void) {
+    ProcStrings *strings = malloc(sizeof(ProcStrings));
+    if (strings == NULL) return NULL;
 
-    if (after->precedent != NULL) {
-        after->precedent->next = new_element;
+    strings->buckets = calloc(STRINGS_MINIMUM_SIZE, sizeof(InternedString *));
+    if (strings->buckets == NULL) {
+        free(strings);
+        return NULL;
     }
 
-    after->precedent = new_element;
-    list->length += 1;
+    strings->length = 0;
+    strings->size = STRINGS_MINIMUM_SIZE;
+    strings->references = 1;
+    return strings;
 }
 
 /*
-  * This function removes and free a process at a specific position.
-  * This function returns 1 if index is greater or equal than list length.
+  * This function frees every string of an intern table and the table itself
+  * when it is not used by another list.
 */
-char remove_proc_index(StartProcList *list, unsigned int index) {
-    if (list->length <= index) {
-        return 1;
-    } else if (index == (list->length - 1)) {
-        ProcessElementList *process = list->last;
-        
-        if (list->last->precedent != NULL) {     // list last is not NULL because the precedent condition check the length is greater than 0
-            list->last->precedent->next = NULL;
-        }
-        
-        list->last = list->last->precedent;
-        list->length -= 1;
-        
-        free(process);
-        
-        return 0;
+static void destroy_strings(ProcStrings *strings) {
+    if (--strings->references) return;
+
+    for (unsigned int bucket = 0; bucket < strings->size; bucket += 1) {
+        InternedString *entry = strings->buckets[bucket];
+
+        while (entry != NULL) {
+            InternedString *next = entry->next;
+            free(entry);
+            entry = next;
+        }
     }
-    
-    ProcessElementList *element = list->first;
-    for (unsigned int position = 0; index > position; position += 1) element = element->next;
 
-    if (element->precedent != NULL) element->precedent->next = element->next;
-    element->next->precedent = element->precedent;  // element next is not NULL because element is not the last element
-    list->length -= 1;
+    free(strings->buckets);
+    free(strings);
+}
 
-    free(element);
+/*
+  * This function doubles the bucket count of an intern table.
+  * The table keeps working with the old buckets if malloc failed.
+*/
+static void grow_strings(ProcStrings *strings) {
+    unsigned int size = strings->size * 2;
+    InternedString **buckets = calloc(size, sizeof(InternedString *));
+    if (buckets == NULL) return;
 
-    return 0;
+    for (unsigned int bucket = 0; bucket < strings->size; bucket += 1) {
+        InternedString *entry = strings->buckets[bucket];
+
+        while (entry != NULL) {
+            InternedString *next = entry->next;
+            entry->next = buckets[entry->hash & (size - 1)];
+            buckets[entry->hash & (size - 1)] = entry;
+            entry = next;
+        }
+    }
+
+    free(strings->buckets);
+    strings->buckets = buckets;
+    strings->size = size;
 }
 
 /*
-  * This function removes and free a specific process.
+  * This function returns the shared copy of a string (length bytes, not
+  * necessarily NUL terminated) and takes a reference on it.
+  * This function returns NULL if malloc failed.
 */
-void remove_proc(StartProcList *list, ProcessElementList *element) {
-    if (element->next != NULL) element->next->precedent = element->precedent;
-    if (element->precedent != NULL) element->precedent->next = element->next;
-    list->length -= 1;
-    free(element);
+static char *intern_string(ProcStrings *strings, const char *value, size_t length) {
+    unsigned int hash = hash_string(value, length);
+    InternedString *entry = strings->buckets[hash & (strings->size - 1)];
+
+    for (; entry != NULL; entry = entry->next) {
+        if (entry->hash == hash && strncmp(entry->value, value, length) == 0 && entry->value[length] == 0) {
+            entry->references += 1;
+            return entry->value;
+        }
+    }
+
+    entry = malloc(sizeof(InternedString) + length + 1);
+    if (entry == NULL) return NULL;
+
+    memcpy(entry->value, value, length);
+    entry->value[length] = 0;
+    entry->hash = hash;
+    entry->references = 1;
+
+    if (strings->length >= strings->size) grow_strings(strings);
+    entry->next = strings->buckets[hash & (strings->size - 1)];
+    strings->buckets[hash & (strings->size - 1)] = entry;
+    strings->length += 1;
+    return entry->value;
 }
 
 /*
-  * This function returns the next process.
-  * This function returns NULL if the list position is greater than the last process position.
+  * This function drops a reference on an interned string, the last one frees it.
 */
-ProcessElementList *get_next_proc(StartProcList *list) {
-    if (list->position == NULL) {
-        return NULL;
+static void release_string(ProcStrings *strings, char *value) {
+    if (value == NULL) return;
+
+    InternedString *entry = (InternedString *)(value - offsetof(InternedString, value));
+    entry->references -= 1;
+    if (entry->references) return;
+
+    InternedString **link = &strings->buckets[entry->hash & (strings->size - 1)];
+    while (*link != entry) link = &(*link)->next;
+    *link = entry->next;
+    strings->length -= 1;
+    free(entry);
+}
+
+/*
+  * This function returns 1 if the process was allocated by new_proc from the
+  * list pool, flags of other processes (allocated by the caller) are not trusted.
+*/
+static char owns_proc(StartProcList *list, ProcessElementList *element) {
+    return list->pool != NULL && pool_owns(list->pool, element);
+}
+
+/*
+  * This function drops the references of the process strings owned by the list.
+*/
+static void release_proc_strings(StartProcList *list, ProcessElementList *element) {
+    if (list->strings == NULL || !(element->flags & PROC_FLAG_INTERNED)) return;
+
+    release_string(list->strings, element->executable);
+    release_string(list->strings, element->cmdline);
+    release_string(list->strings, element->user);
+    element->executable = NULL;
+    element->cmdline = NULL;
+    element->user = NULL;
+    element->flags &= ~PROC_FLAG_INTERNED;
+}
+
+struct ProcScanner {
+    int proc_fd;                     // held /proc directory, files are opened relative to it
+    DIR *directory;                  // /proc listing, rewound for each scan
+    long ticks;                      // clock ticks per second
+    long double boot_time;           // boot timestamp (btime in /proc/stat)
+
+    unsigned long long total_time;   // sum of all CPUs times (clock ticks) at the last scan
+    float elapsed;                   // clock ticks per CPU between the two last scans, 0: first scan
+    unsigned int cpu_count;
+    float page_percent;              // memory percent of one page
+
+    char *buffer;                    // reusable file buffer, grows for long command lines
+    size_t buffer_size;
+    char link[SCANNER_LINK_SIZE];    // exe link target
+    char user[SCANNER_USER_SIZE];    // getpwuid_r buffer
+    char path[48];                   // "<pid>/<file>" or "<pid>/task/<tid>/stat"
+    unsigned char fields;            // PROC_FIELD_* strings read by scans, others are loaded on access
+
+    UserEntry *users;                // UID to user name cache (open addressing)
+    unsigned int users_length;
+    unsigned int users_size;         // always a power of two
+    struct timespec passwd_time;     // /etc/passwd mtime when the cache has been filled
+};
+
+typedef struct ProcStat {
+    const char *comm;                // points into the scanner buffer, not NUL terminated
+    size_t comm_length;
+    char state;
+    unsigned int ppid;
+    int tty_nr;
+    unsigned long long utime;
+    unsigned long long stime;
+    unsigned long long starttime;
+    unsigned long long rss;
+    int processor;
+} ProcStat;
+
+/*
+  * This function frees the cached user names and releases their interned
+  * copies in the list string table (NULL: nothing has been interned), the
+  * cache is kept allocated.
+*/
+static void clear_users(ProcScanner *scanner, ProcStrings *strings) {
+    for (unsigned int slot = 0; slot < scanner->users_size; slot += 1) {
+        free(scanner->users[slot].name);
+        if (strings != NULL) release_string(strings, scanner->users[slot].interned);
+        scanner->users[slot].name = NULL;
+        scanner->users[slot].interned = NULL;
     }
-    ProcessElementList *process = list->position;
-    list->position = process->next;
-    return process;
+
+    scanner->users_length = 0;
 }
 
 /*
-  * This function returns the precedent process.
-  * This function returns NULL if the list position is smaller than the first process position.
+  * This function empties the user cache if /etc/passwd has been modified,
+  * it is called at the start of each scan and by lookups outside scans.
 */
-ProcessElementList *get_precedent_proc(StartProcList *list) {
-    if (list->position == NULL) {
-        return NULL;
+static void check_users(ProcScanner *scanner, ProcStrings *strings) {
+    struct stat passwd;
+    if (stat("/etc/passwd", &passwd)) return;
+
+    if (passwd.st_mtim.tv_sec != scanner->passwd_time.tv_sec || passwd.st_mtim.tv_nsec != scanner->passwd_time.tv_nsec) {
+        clear_users(scanner, strings);
+        scanner->passwd_time = passwd.st_mtim;
     }
-    
-    ProcessElementList *process = list->position;
-    list->position = process->precedent;
-    return process;
 }
 
 /*
-  * This function returns a process by index.
-  * This function returns NULL if index is greater or equal than list length.
+  * This function returns the cache entry of a UID, getpwuid_r is only
+  * called for the first lookup of each UID.
+  * This function returns NULL if malloc failed.
 */
-ProcessElementList *get_proc(StartProcList *list, unsigned int index) {
-    if (index >= list->length) {
-        return NULL;
+static UserEntry *find_user(ProcScanner *scanner, unsigned int uid) {
+    if ((scanner->users_length + 1) * 2 > scanner->users_size) {
+        unsigned int size = scanner->users_size ? scanner->users_size * 2 : USERS_MINIMUM_SIZE;
+        UserEntry *users = calloc(size, sizeof(UserEntry));
+        if (users == NULL) return NULL;
+
+        for (unsigned int slot = 0; slot < scanner->users_size; slot += 1) {
+            if (scanner->users[slot].name == NULL) continue;
+
+            unsigned int new_slot = (scanner->users[slot].uid * 2654435761u) & (size - 1);
+            while (users[new_slot].name != NULL) new_slot = (new_slot + 1) & (size - 1);
+            users[new_slot] = scanner->users[slot];
+        }
+
+        free(scanner->users);
+        scanner->users = users;
+        scanner->users_size = size;
     }
-    
-    ProcessElementList *element = list->first;
-    for (unsigned int position = 0; index > position; position += 1) {
-        element = element->next;
+
+    unsigned int mask = scanner->users_size - 1;
+    unsigned int slot = (uid * 2654435761u) & mask;
+
+    while (scanner->users[slot].name != NULL) {
+        if (scanner->users[slot].uid == uid) return &scanner->users[slot];
+        slot = (slot + 1) & mask;
     }
 
-    return element;
+    struct passwd entry, *result = NULL;
+    char user[16];
+    getpwuid_r(uid, &entry, scanner->user, SCANNER_USER_SIZE, &result);
+    if (result == NULL) snprintf(user, sizeof(user), "%u", uid);
+
+    char *name = strdup(result != NULL ? result->pw_name : user);
+    if (name == NULL) return NULL;
+
+    scanner->users[slot].uid = uid;
+    scanner->users[slot].name = name;
+    scanner->users_length += 1;
+    return &scanner->users[slot];
 }
 
 /*
-  * This function returns a process by PID.
-  * This function returns NULL if PID is not found.
+  * This function returns the user name of a UID from the scanner cache.
+  * This function returns NULL if malloc failed.
 */
-ProcessElementList *get_proc_pid(StartProcList *list, unsigned int pid) {
-    ProcessElementList *element = list->first;
-    while (element != NULL && element->pid != pid) element = element->next;
-    if (element == NULL) return NULL;
-    return element;
+static const char *resolve_user(ProcScanner *scanner, unsigned int uid) {
+    UserEntry *user = find_user(scanner, uid);
+    return user != NULL ? user->name : NULL;
 }
 
 /*
-  * This function places list on the first position.
+  * This function returns the user name of a UID interned in the list string
+  * table, the copy is cached by UID so processes of a user share it without
+  * hashing the name again. The caller takes its own reference.
+  * This function returns NULL if malloc failed.
 */
-void goto_first_position (StartProcList *list) {
-    list->position = list->first;
+static char *resolve_interned_user(StartProcList *list, ProcScanner *scanner, unsigned int uid) {
+    UserEntry *user = find_user(scanner, uid);
+    if (user == NULL || enable_proc_strings(list)) return NULL;
+
+    if (user->interned == NULL) user->interned = intern_string(list->strings, user->name, strlen(user->name));
+    return user->interned;
 }
 
 /*
-  * This function places list on the last position.
+  * This function closes the /proc directory and frees the scanner,
+  * strings is the list string table (interned user names are released).
 */
-void goto_last_position (StartProcList *list) {
-    list->position = list->last;
+static void destroy_scanner(ProcScanner *scanner, ProcStrings *strings) {
+    clear_users(scanner, strings);
+    free(scanner->users);
+    if (scanner->directory != NULL) closedir(scanner->directory);
+    if (scanner->proc_fd >= 0) close(scanner->proc_fd);
+    free(scanner->buffer);
+    free(scanner);
+}
+
+/*
+  * This function reads a whole file relative to a directory in the scanner buffer.
+  * This function returns the file length or -1 if the file cannot be read.
+*/
+static ssize_t read_scanner_file(ProcScanner *scanner, int directory, const char *path) {
+    int file = openat(directory, path, O_RDONLY | O_CLOEXEC);
+    if (file < 0) return -1;
+
+    size_t length = 0;
+    for (;;) {
+        if (length + 1 >= scanner->buffer_size) {
+            char *buffer = realloc(scanner->buffer, scanner->buffer_size * 2);
+            if (buffer == NULL) break;
+            scanner->buffer = buffer;
+            scanner->buffer_size *= 2;
+        }
+
+        ssize_t size = read(file, scanner->buffer + length, scanner->buffer_size - length - 1);
+        if (size <= 0) {
+            if (size < 0 && length == 0) length = (size_t)-1;
+            break;
+        }
+        length += size;
+    }
+
+    close(file);
+    if (length == (size_t)-1) return -1;
+    scanner->buffer[length] = 0;
+    return length;
 }
 
+/*
+  * This function creates the scanner: opens /proc and reads boot time.
+  * This function returns NULL if /proc cannot be opened or malloc failed.
+*/
+static ProcScanner *create_scanner(void) {
+    ProcScanner *scanner = calloc(1, sizeof(ProcScanner));
+    if (scanner == NULL) return NULL;
+
+    scanner->buffer = malloc(SCANNER_BUFFER_SIZE);
+    scanner->buffer_size = SCANNER_BUFFER_SIZE;
+    scanner->proc_fd = open("/proc", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    scanner->ticks = sysconf(_SC_CLK_TCK);
+    scanner->fields = PROC_FIELD_ALL;
+
+    int directory = scanner->proc_fd >= 0 ? dup(scanner->proc_fd) : -1;
+    if (directory >= 0) scanner->directory = fdopendir(directory);
+
+    if (scanner->buffer == NULL || scanner->directory == NULL || scanner->ticks <= 0 || read_scanner_file(scanner, scanner->proc_fd, "stat") < 0) {
+        if (scanner->directory == NULL && directory >= 0) close(directory);
+        destroy_scanner(scanner, NULL);
+        return NULL;
+    }
+
+    char *line = strstr(scanner->buffer, "\nbtime ");
+    if (line != NULL) scanner->boot_time = strtoull(line + 7, NULL, 10);
+
+    for (line = strstr(scanner->buffer, "\ncpu"); line != NULL; line = strstr(line + 4, "\ncpu")) {
+        scanner->cpu_count += 1;
+    }
+
+    if (read_scanner_file(scanner, scanner->proc_fd, "meminfo") >= 0 && (line = strstr(scanner->buffer, "MemTotal:")) != NULL) {
+        unsigned long long memory_total = strtoull(line + 9, NULL, 10) * 1024;
+        if (memory_total) scanner->page_percent = 100.0 * sysconf(_SC_PAGESIZE) / memory_total;
+    }
+
+    return scanner;
+}
+
+/*
+  * This function reads the total CPU time in /proc/stat at the start of a scan.
+*/
+static void sample_total_time(ProcScanner *scanner) {
+    if (read_scanner_file(scanner, scanner->proc_fd, "stat") < 0) return;
+
+    char *field = scanner->buffer + 3;
+    unsigned long long total_time = 0;
+    for (unsigned int position = 0; position < 8; position += 1) total_time += strtoull(field, &field, 10);  // guest times are in user and nice
+
+    if (scanner->total_time && total_time > scanner->total_time && scanner->cpu_count) {
+        scanner->elapsed = (float)(total_time - scanner->total_time) / scanner->cpu_count;
+    } else {
+        scanner->elapsed = 0;
+    }
+
+    scanner->total_time = total_time;
+}
+
+/*
+  * This function updates CPU and memory usage of a process from its stat,
+  * cpu_time must be the previous sample (0 for a process started after it).
+*/
+static void update_proc_usage(ProcScanner *scanner, ProcStat *stat, ProcessElementList *element) {
+    unsigned long long cpu_time = stat->utime + stat->stime;
+
+    if (scanner->elapsed && cpu_time >= element->cpu_time) {
+        element->cpu_usage = 100.0f * (cpu_time - element->cpu_time) / scanner->elapsed;
+    } else {
+        element->cpu_usage = 0;
+    }
+
+    element->cpu_time = cpu_time;
+    element->memory_usage = scanner->page_percent * stat->rss;
+}
+
+/*
+  * This function returns the list scanner, created on first use.
+  * This function returns NULL if the scanner cannot be created.
+*/
+static ProcScanner *get_scanner(StartProcList *list) {
+    if (list->scanner == NULL) list->scanner = create_scanner();
+    return list->scanner;
+}
+
+/*
+  * This function parses /proc/<pid>/stat from the scanner buffer.
+  * This function returns 1 if the format is not valid.
+*/
+static char parse_proc_stat(ProcScanner *scanner, ProcStat *stat) {
+    char *start = strchr(scanner->buffer, '(');
+    char *end = strrchr(scanner->buffer, ')');   // comm can contains ')'
+    if (start == NULL || end == NULL || end[1] == 0) return 1;
+
+    stat->comm = start + 1;
+    stat->comm_length = end - start - 1;
+    stat->state = end[2];
+
+    char *field = end + 3;
+    for (unsigned int position = 4; position <= 39 && *field; position += 1) {
+        unsigned long long value = strtoull(field, &field, 10);
+
+        switch (position) {
+            case 4: stat->ppid = value; break;
+            case 7: stat->tty_nr = value; break;
+            case 14: stat->utime = value; break;
+            case 15: stat->stime = value; break;
+            case 22: stat->starttime = value; break;
+            case 24: stat->rss = value; break;
+            case 39: stat->processor = value; break;
+        }
+
+        while (*field == ' ') field += 1;
+    }
+
+    return 0;
+}
+
+/*
+  * This function reads and parses /proc/<pid>/stat.
+  * This function returns 1 if the process has exited.
+*/
+static char read_proc_stat(ProcScanner *scanner, unsigned int pid, ProcStat *stat) {
+    snprintf(scanner->path, sizeof(scanner->path), "%u/stat", pid);
+    if (read_scanner_file(scanner, scanner->proc_fd, scanner->path) < 0) return 1;
+    return parse_proc_stat(scanner, stat);
+}
+
+/*
+  * This function returns the start timestamp of a process from its stat.
+*/
+static long double get_start_timestamp(ProcScanner *scanner, ProcStat *stat) {
+    return scanner->boot_time + (long double)stat->starttime / scanner->ticks;
+}
+
+static char assign_proc_strings(StartProcList *list, ProcessElementList *element, const char *executable, const char *cmdline, const char *user, char user_interned);
+
+/*
+  * This function reads the requested fields (PROC_FIELD_* bits) of a process
+  * from /proc/<pid>/{exe,status,cmdline}, other strings are kept. The parsed
+  * stat must be the last file read by the scanner (comm is the executable
+  * fallback). Strings are interned in the list string table.
+  * This function returns 1 if the process has exited or malloc failed.
+*/
+static char read_proc_fields(StartProcList *list, ProcScanner *scanner, unsigned int pid, ProcStat *stat, ProcessElementList *element, unsigned char fields) {
+    const char *values[3] = {element->executable, element->cmdline, element->user};
+
+    if (fields & PROC_FIELD_EXECUTABLE) {
+        snprintf(scanner->path, sizeof(scanner->path), "%u/exe", pid);
+        ssize_t link_length = readlinkat(scanner->proc_fd, scanner->path, scanner->link, SCANNER_LINK_SIZE - 1);
+
+        if (link_length < 0) {           // kernel thread or not allowed: use comm
+            link_length = stat->comm_length < SCANNER_LINK_SIZE - 1 ? stat->comm_length : SCANNER_LINK_SIZE - 1;
+            memcpy(scanner->link, stat->comm, link_length);
+        }
+        scanner->link[link_length] = 0;
+        values[0] = scanner->link;
+    }
+
+    if (fields & PROC_FIELD_USER) {
+        snprintf(scanner->path, sizeof(scanner->path), "%u/status", pid);
+        if (read_scanner_file(scanner, scanner->proc_fd, scanner->path) < 0) return 1;
+
+        char *uid_line = strstr(scanner->buffer, "\nUid:");
+        values[2] = resolve_interned_user(list, scanner, uid_line != NULL ? strtoul(uid_line + 5, NULL, 10) : 0);
+        if (values[2] == NULL) return 1;
+    }
+
+    if (fields & PROC_FIELD_CMDLINE) {
+        snprintf(scanner->path, sizeof(scanner->path), "%u/cmdline", pid);
+        ssize_t cmdline_length = read_scanner_file(scanner, scanner->proc_fd, scanner->path);
+        if (cmdline_length < 0) return 1;
+
+        while (cmdline_length > 0 && scanner->buffer[cmdline_length - 1] == 0) cmdline_length -= 1;
+        for (ssize_t position = 0; position < cmdline_length; position += 1) {
+            if (scanner->buffer[position] == 0) scanner->buffer[position] = ' ';
+        }
+        scanner->buffer[cmdline_length] = 0;
+        values[1] = scanner->buffer;
+    }
+
+    if (assign_proc_strings(list, element, values[0], values[1], values[2], (fields & PROC_FIELD_USER) != 0)) return 1;
+    element->flags &= ~(fields << PROC_FLAG_PENDING_SHIFT);
+    return 0;
+}
+
+/*
+  * This function fills a process from its parsed stat (that must be the last
+  * file read by the scanner) and the strings of the scanner field mask,
+  * other strings are NULL and marked pending (loaded by get_proc_executable,
+  * get_proc_cmdline, get_proc_user or load_proc_fields).
+  * This function returns 1 if the process has exited or malloc failed.
+*/
+static char read_proc(StartProcList *list, ProcScanner *scanner, unsigned int pid, ProcStat *stat, ProcessElementList *element) {
+    element->pid = pid;
+    element->ppid = stat->ppid;
+    element->tty = stat->tty_nr != 0;
+    element->start_timestamp = get_start_timestamp(scanner, stat);
+    update_proc_usage(scanner, stat, element);
+
+    element->flags |= (PROC_FIELD_ALL & ~scanner->fields) << PROC_FLAG_PENDING_SHIFT;
+    if (scanner->fields == 0) return 0;
+    return read_proc_fields(list, scanner, pid, stat, element, scanner->fields);
+}
+
+typedef struct ProcChunk {
+    ProcessElementList *first;       // chunk processes are contiguous in the list
+    unsigned int position;           // index of the chunk in ProcPositions arrays
+} ProcChunk;
+
+struct ProcPositions {
+    ProcChunk **chunks;              // chunks in list order
+    unsigned int *counts;            // processes by chunk, contiguous for fast prefix sums
+    unsigned int length;
+    unsigned int size;
+};
+
+/*
+  * This function frees every chunk of the positional index and the index itself.
+*/
+static void destroy_positions(ProcPositions *positions) {
+    for (unsigned int position = 0; position < positions->length; position += 1) free(positions->chunks[position]);
+    free(positions->chunks);
+    free(positions->counts);
+    free(positions);
+}
+
+/*
+  * This function inserts a new empty chunk at a position of the index.
+  * This function returns NULL if malloc failed.
+*/
+static ProcChunk *insert_chunk(ProcPositions *positions, unsigned int position, ProcessElementList *first) {
+    if (positions->length == positions->size) {
+        unsigned int size = positions->size ? positions->size * 2 : 64;
+        ProcChunk **chunks = realloc(positions->chunks, size * sizeof(ProcChunk *));
+        if (chunks == NULL) return NULL;
+        positions->chunks = chunks;
+
+        unsigned int *counts = realloc(positions->counts, size * sizeof(unsigned int));
+        if (counts == NULL) return NULL;
+        positions->counts = counts;
+        positions->size = size;
+    }
+
+    ProcChunk *chunk = malloc(sizeof(ProcChunk));
+    if (chunk == NULL) return NULL;
+    chunk->first = first;
+
+    memmove(positions->chunks + position + 1, positions->chunks + position, (positions->length - position) * sizeof(ProcChunk *));
+    memmove(positions->counts + position + 1, positions->counts + position, (positions->length - position) * sizeof(unsigned int));
+    positions->chunks[position] = chunk;
+    positions->counts[position] = 0;
+    positions->length += 1;
+
+    for (unsigned int index = position; index < positions->length; index += 1) positions->chunks[index]->position = index;
+    return chunk;
+}
+
+/*
+  * This function removes an empty chunk from the index.
+*/
+static void remove_chunk(ProcPositions *positions, ProcChunk *chunk) {
+    unsigned int position = chunk->position;
+    positions->length -= 1;
+
+    memmove(positions->chunks + position, positions->chunks + position + 1, (positions->length - position) * sizeof(ProcChunk *));
+    memmove(positions->counts + position, positions->counts + position + 1, (positions->length - position) * sizeof(unsigned int));
+    for (unsigned int index = position; index < positions->length; index += 1) positions->chunks[index]->position = index;
+    free(chunk);
+}
+
+/*
+  * This function returns the target chunk size, about sqrt(length / POSITIONS_WALK_COST):
+  * scanning contiguous counts is much cheaper than walking scattered nodes.
+*/
+static unsigned int get_chunk_size(unsigned int length) {
+    unsigned int size = POSITIONS_MINIMUM_CHUNK;
+    while ((unsigned long long)size * size * POSITIONS_WALK_COST < length) size *= 2;
+    return size;
+}
+
+/*
+  * This function splits a chunk in two halves when it is too big.
+  * The chunk is kept whole if malloc failed.
+*/
+static void split_chunk(ProcPositions *positions, ProcChunk *chunk, unsigned int length) {
+    unsigned int count = positions->counts[chunk->position];
+    unsigned int half = count / 2;
+    if (count <= 2 * get_chunk_size(length)) return;
+
+    ProcessElementList *element = chunk->first;
+    for (unsigned int index = 0; index < half; index += 1) element = element->next;
+
+    ProcChunk *new_chunk = insert_chunk(positions, chunk->position + 1, element);
+    if (new_chunk == NULL) return;
+
+    positions->counts[chunk->position] = half;
+    positions->counts[new_chunk->position] = count - half;
+    for (unsigned int index = half; index < count; index += 1, element = element->next) element->chunk = new_chunk;
+}
+
+/*
+  * This function merges a chunk smaller than half the target size into its
+  * neighbour, so shrinking lists keep O(sqrt(n)) chunks (a merged chunk is
+  * at most 2.5 times the target size). Processes being unlinked are not in
+  * a chunk anymore (NULL) and are skipped.
+*/
+static void merge_chunk(ProcPositions *positions, ProcChunk *chunk) {
+    ProcChunk *kept = chunk->position ? positions->chunks[chunk->position - 1] : chunk;
+    ProcChunk *merged = chunk->position ? chunk : positions->chunks[1];
+    unsigned int count = positions->counts[merged->position];
+
+    ProcessElementList *element = merged->first;
+    for (unsigned int index = 0; index < count; element = element->next) {
+        if (element->chunk != merged) continue;
+        element->chunk = kept;
+        index += 1;
+    }
+
+    positions->counts[kept->position] += count;
+    positions->counts[merged->position] = 0;
+    remove_chunk(positions, merged);
+}
+
+/*
+  * This function adds a linked process in the chunk of its precedent
+  * (or next for the first process).
+  * The positional index is dropped if malloc failed.
+*/
+static void position_proc(StartProcList *list, ProcessElementList *element) {
+    ProcPositions *positions = list->positions;
+    if (positions == NULL) return;
+
+    ProcChunk *chunk;
+    if (element->precedent != NULL) {
+        chunk = element->precedent->chunk;
+    } else if (element->next != NULL) {
+        chunk = element->next->chunk;
+        chunk->first = element;
+    } else {
+        chunk = insert_chunk(positions, 0, element);
+        if (chunk == NULL) {
+            destroy_positions(positions);
+            list->positions = NULL;
+            return;
+        }
+    }
+
+    element->chunk = chunk;
+    positions->counts[chunk->position] += 1;
+    split_chunk(positions, chunk, list->length);
+}
+
+/*
+  * This function removes a process from its chunk before it is unlinked.
+*/
+static void unposition_proc(StartProcList *list, ProcessElementList *element) {
+    ProcPositions *positions = list->positions;
+    if (positions == NULL) return;
+
+    ProcChunk *chunk = element->chunk;
+    element->chunk = NULL;
+    positions->counts[chunk->position] -= 1;
+
+    if (positions->counts[chunk->position] == 0) {
+        remove_chunk(positions, chunk);
+        return;
+    }
+
+    if (chunk->first == element) chunk->first = element->next;
+    if (positions->counts[chunk->position] * 2 < get_chunk_size(list->length - 1) && positions->length > 1) merge_chunk(positions, chunk);
+}
+
+/*
+  * This function returns the process at an index (lower than the length),
+  * walking from the nearest end of the list or of its chunk.
+*/
+static ProcessElementList *find_proc_index(StartProcList *list, unsigned int index) {
+    ProcPositions *positions = list->positions;
+    ProcessElementList *element;
+
+    if (positions == NULL) {
+        if (index < list->length / 2) {
+            element = list->first;
+            for (unsigned int position = 0; position < index; position += 1) element = element->next;
+        } else {
+            element = list->last;
+            for (unsigned int position = list->length - 1; position > index; position -= 1) element = element->precedent;
+        }
+        return element;
+    }
+
+    unsigned int chunk = 0, start = 0;
+
+    if (index < list->length / 2) {
+        while (start + positions->counts[chunk] <= index) start += positions->counts[chunk++];
+    } else {
+        chunk = positions->length - 1;
+        start = list->length - positions->counts[chunk];
+        while (start > index) start -= positions->counts[--chunk];
+    }
+
+    unsigned int count = positions->counts[chunk];
+    if (index - start < count / 2 || chunk + 1 == positions->length) {
+        element = positions->chunks[chunk]->first;
+        for (unsigned int position = start; position < index; position += 1) element = element->next;
+    } else {
+        element = positions->chunks[chunk + 1]->first->precedent;
+        for (unsigned int position = start + count - 1; position > index; position -= 1) element = element->precedent;
+    }
+
+    return element;
+}
+
+typedef struct TrigramPostings {
+    unsigned int *ids;               // ascending ids of processes containing the trigram
+    unsigned int length;
+    unsigned int size;
+} TrigramPostings;
+
+struct ProcTrigrams {
+    TrigramPostings buckets[TRIGRAM_BUCKETS];
+    ProcessElementList **elements;   // process by id, NULL: removed (id 0 is never used)
+    unsigned int length;             // next id, ids are increasing so postings stay sorted by appending
+    unsigned int size;
+    unsigned int removed;
+};
+
+/*
+  * This function returns the bucket of the trigram starting at text.
+*/
+static unsigned int hash_trigram(const char *text) {
+    unsigned int trigram = (unsigned char)text[0] << 16 | (unsigned char)text[1] << 8 | (unsigned char)text[2];
+    return (trigram * 2654435761u) >> 16;
+}
+
+/*
+  * This function frees a trigram index.
+*/
+static void destroy_trigrams(ProcTrigrams *trigrams) {
+    for (unsigned int bucket = 0; bucket < TRIGRAM_BUCKETS; bucket += 1) free(trigrams->buckets[bucket].ids);
+    free(trigrams->elements);
+    free(trigrams);
+}
+
+/*
+  * This function adds the trigrams of a string to the postings of an id.
+  * This function returns 1 if malloc failed.
+*/
+static char add_trigrams(ProcTrigrams *trigrams, const char *text, unsigned int id) {
+    if (text == NULL) return 0;
+
+    for (size_t position = 0; text[position] != 0 && text[position + 1] != 0 && text[position + 2] != 0; position += 1) {
+        TrigramPostings *postings = &trigrams->buckets[hash_trigram(text + position)];
+        if (postings->length && postings->ids[postings->length - 1] == id) continue;
+
+        if (postings->length == postings->size) {
+            unsigned int size = postings->size ? postings->size * 2 : 4;
+            unsigned int *ids = realloc(postings->ids, size * sizeof(unsigned int));
+            if (ids == NULL) return 1;
+
+            postings->ids = ids;
+            postings->size = size;
+        }
+
+        postings->ids[postings->length++] = id;
+    }
+
+    return 0;
+}
+
+/*
+  * This function removes the ids of removed processes from the postings
+  * and renumbers the others (the order is kept so postings stay sorted).
+  * Nothing is done if malloc failed.
+*/
+static void compact_trigrams(ProcTrigrams *trigrams) {
+    unsigned int *ids = malloc(trigrams->length * sizeof(unsigned int));
+    if (ids == NULL) return;
+
+    unsigned int length = 1;
+    for (unsigned int id = 1; id < trigrams->length; id += 1) {
+        ProcessElementList *element = trigrams->elements[id];
+        ids[id] = element != NULL ? length : 0;
+        if (element == NULL) continue;
+
+        element->trigram_id = length;
+        trigrams->elements[length++] = element;
+    }
+
+    for (unsigned int bucket = 0; bucket < TRIGRAM_BUCKETS; bucket += 1) {
+        TrigramPostings *postings = &trigrams->buckets[bucket];
+        unsigned int kept = 0;
+
+        for (unsigned int position = 0; position < postings->length; position += 1) {
+            unsigned int id = ids[postings->ids[position]];
+            if (id) postings->ids[kept++] = id;
+        }
+
+        postings->length = kept;
+    }
+
+    free(ids);
+    trigrams->length = length;
+    trigrams->removed = 0;
+}
+
+/*
+  * This function adds a process in the list trigram index, if enabled.
+  * When the index cannot grow it is dropped and search_procs scans the list again.
+*/
+static void trigram_proc(StartProcList *list, ProcessElementList *element) {
+    ProcTrigrams *trigrams = list->trigrams;
+    if (trigrams == NULL) return;
+
+    if (trigrams->length == trigrams->size) {
+        unsigned int size = trigrams->size * 2;
+        ProcessElementList **elements = realloc(trigrams->elements, size * sizeof(ProcessElementList *));
+
+        if (elements == NULL) {
+            destroy_trigrams(trigrams);
+            list->trigrams = NULL;
+            return;
+        }
+
+        trigrams->elements = elements;
+        trigrams->size = size;
+    }
+
+    unsigned int id = trigrams->length++;
+    trigrams->elements[id] = element;
+    element->trigram_id = id;
+
+    if (add_trigrams(trigrams, element->executable, id) || add_trigrams(trigrams, element->cmdline, id)) {
+        destroy_trigrams(trigrams);
+        list->trigrams = NULL;
+    }
+}
+
+/*
+  * This function removes a process from the list trigram index, if enabled:
+  * its id is released and the postings are compacted when half of the ids are removed.
+  * This function returns 1 if the process was indexed.
+*/
+static char untrigram_proc(StartProcList *list, ProcessElementList *element) {
+    ProcTrigrams *trigrams = list->trigrams;
+    unsigned int id = element->trigram_id;
+    if (trigrams == NULL || id == 0 || id >= trigrams->length || trigrams->elements[id] != element) return 0;
+
+    trigrams->elements[id] = NULL;
+    trigrams->removed += 1;
+    element->trigram_id = 0;
+
+    if (trigrams->removed >= TRIGRAM_MINIMUM_REMOVED && trigrams->removed * 2 > trigrams->length) compact_trigrams(trigrams);
+    return 1;
+}
+
+/*
+  * This function returns 1 if an optional index is updated for each linked process.
+*/
+static char has_proc_indexes(StartProcList *list) {
+    return list->index != NULL || list->positions != NULL || list->trigrams != NULL;
+}
+
+/*
+  * This function updates the optional indexes after a process has been linked.
+*/
+static void attach_proc(StartProcList *list, ProcessElementList *element) {
+    if (element->flags && !owns_proc(list, element)) element->flags = 0;
+    index_proc(list, element);
+    position_proc(list, element);
+    trigram_proc(list, element);
+}
+
+/*
+  * This function updates the optional indexes before a process is unlinked.
+*/
+static void detach_proc(StartProcList *list, ProcessElementList *element) {
+    unindex_proc(list, element);
+    unposition_proc(list, element);
+    untrigram_proc(list, element);
+}
+
+/*
+  * This function initializes the process list.
+*/
+void init_proc_list(StartProcList *list) {
+    list->length = 0;
+    list->first = NULL;
+    list->last = NULL;
+    list->position = NULL;
+    list->index = NULL;
+    list->pool = NULL;
+    list->strings = NULL;
+    list->scanner = NULL;
+    list->positions = NULL;
+    list->thread_pool = NULL;
+    list->trigrams = NULL;
+};
+
+/*
+  * This function enables the positional index: processes are grouped in
+  * chunks of O(sqrt(length)) processes with their counts, get_proc,
+  * insert_proc and remove_proc_index become O(sqrt(n)).
+  * This function returns 1 if malloc failed.
+*/
+char enable_proc_positions(StartProcList *list) {
+    if (list->positions != NULL) return 0;
+
+    ProcPositions *positions = calloc(1, sizeof(ProcPositions));
+    if (positions == NULL) return 1;
+
+    unsigned int chunk_size = get_chunk_size(list->length);
+    ProcChunk *chunk = NULL;
+
+    for (ProcessElementList *element = list->first; element != NULL; element = element->next) {
+        if (chunk == NULL || positions->counts[chunk->position] == chunk_size) {
+            chunk = insert_chunk(positions, positions->length, element);
+            if (chunk == NULL) {
+                destroy_positions(positions);
+                return 1;
+            }
+        }
+
+        element->chunk = chunk;
+        positions->counts[chunk->position] += 1;
+    }
+
+    list->positions = positions;
+    return 0;
+}
+
+/*
+  * This function enables the node pool: new_proc hands out nodes from contiguous
+  * chunks of chunk_size (0: default) doubling nodes and removed nodes are recycled.
+  * Nodes allocated with malloc by the caller can still be added to the list.
+  * This function returns 1 if malloc failed.
+*/
+char enable_proc_pool(StartProcList *list, unsigned int chunk_size) {
+    if (list->pool != NULL) return 0;
+
+    list->pool = create_pool(sizeof(ProcessElementList), chunk_size);
+    return list->pool == NULL;
+}
+
+/*
+  * This function initializes the process list with a node pool.
+  * This function returns 1 if malloc failed.
+*/
+char init_proc_list_with_pool(StartProcList *list, unsigned int chunk_size) {
+    init_proc_list(list);
+    return enable_proc_pool(list, chunk_size);
+}
+
+/*
+  * This function returns a new zeroed process from the list pool (enabled if needed).
+  * This function returns NULL if malloc failed.
+*/
+ProcessElementList *new_proc(StartProcList *list) {
+    if (enable_proc_pool(list, 0)) return NULL;
+    return allocate_pool_item(list->pool);
+}
+
+/*
+  * This function frees a process that is not in the list anymore
+  * (returned by pop_proc or popleft_proc), pooled processes are recycled
+  * with their strings and threads, others are freed (their interned
+  * strings are released with the list).
+*/
+void free_proc(StartProcList *list, ProcessElementList *element) {
+    if (!owns_proc(list, element)) {
+        free(element);
+        return;
+    }
+
+    release_proc_strings(list, element);
+    free_proc_threads(list, element);
+    release_pool_item(list->pool, element);
+}
+
+/*
+  * This function returns the number of chunks allocated by the node pool.
+*/
+unsigned int count_proc_pool_chunks(StartProcList *list) {
+    unsigned int count = 0;
+    if (list->pool == NULL) return 0;
+
+    for (PoolChunk *chunk = list->pool->chunks; chunk != NULL; chunk = chunk->next) count += 1;
+    return count;
+}
+
+/*
+  * This function enables the PID hash index, get_proc_pid becomes O(1).
+  * Processes already in the list are indexed, PIDs should be unique.
+  * This function returns 1 if malloc failed.
+*/
+char enable_proc_pid_index(StartProcList *list) {
+    if (list->index != NULL) return 0;
+
+    ProcPidIndex *index = malloc(sizeof(ProcPidIndex));
+    if (index == NULL) return 1;
+
+    unsigned int size = PID_INDEX_MINIMUM_SIZE;
+    while (size < list->length * 2) size *= 2;
+
+    if (allocate_pid_index(index, size)) {
+        free(index);
+        return 1;
+    }
+
+    for (ProcessElementList *element = list->first; element != NULL; element = element->next) {
+        put_pid_index(index, element);
+    }
+
+    list->index = index;
+    return 0;
+}
+
+/*
+  * This function enables the trigram index over executable and cmdline:
+  * search_procs only verifies processes having every trigram of the text.
+  * Processes already in the list are indexed, the index is updated when
+  * processes are linked, unlinked or get new strings (set_proc_strings).
+  * This function returns 1 if malloc failed.
+*/
+char enable_proc_trigrams(StartProcList *list) {
+    if (list->trigrams != NULL) return 0;
+
+    ProcTrigrams *trigrams = calloc(1, sizeof(ProcTrigrams));
+    if (trigrams == NULL) return 1;
+
+    trigrams->size = PID_INDEX_MINIMUM_SIZE;
+    while (trigrams->size <= list->length) trigrams->size *= 2;
+
+    trigrams->elements = malloc(trigrams->size * sizeof(ProcessElementList *));
+    if (trigrams->elements == NULL) {
+        free(trigrams);
+        return 1;
+    }
+
+    trigrams->length = 1;
+    list->trigrams = trigrams;
+
+    for (ProcessElementList *element = list->first; element != NULL && list->trigrams != NULL; element = element->next) {
+        trigram_proc(list, element);
+    }
+
+    return list->trigrams == NULL;
+}
+
+/*
+  * This function returns 1 if executable or cmdline of a process contains text.
+*/
+static char match_proc_text(ProcessElementList *element, const char *text) {
+    return (element->cmdline != NULL && strstr(element->cmdline, text) != NULL) || (element->executable != NULL && strstr(element->executable, text) != NULL);
+}
+
+/*
+  * This function returns the first position from position with an id
+  * greater or equal than id (exponential then binary search).
+*/
+static unsigned int seek_postings(const TrigramPostings *postings, unsigned int position, unsigned int id) {
+    if (position >= postings->length || postings->ids[position] >= id) return position;
+
+    unsigned int low = position, step = 1;
+    while (low + step < postings->length && postings->ids[low + step] < id) {
+        low += step;
+        step *= 2;
+    }
+
+    unsigned int high = low + step < postings->length ? low + step : postings->length;
+    while (high - low > 1) {
+        unsigned int middle = low + (high - low) / 2;
+        if (postings->ids[middle] < id) {
+            low = middle;
+        } else {
+            high = middle;
+        }
+    }
+
+    return high;
+}
+
+/*
+  * This function writes up to size processes whose executable or cmdline
+  * contains text (like pgrep -f) and returns the number of matches (may be
+  * greater than size). With the trigram index, the postings of the text
+  * trigrams are intersected from the shortest and candidates are verified,
+  * matches are then in index order (not list order). Without index or for
+  * a text shorter than 3 characters the list is scanned.
+  * Pending strings (scan field mask) are not searched.
+*/
+unsigned int search_procs(StartProcList *list, const char *text, ProcessElementList **matches, unsigned int size) {
+    ProcTrigrams *trigrams = list->trigrams;
+    size_t length = strlen(text);
+    unsigned int count = 0;
+    unsigned int *buckets;
+
+    if (trigrams == NULL || length < 3 || (buckets = malloc((length - 2) * 2 * sizeof(unsigned int))) == NULL) {
+        for (ProcessElementList *element = list->first; element != NULL; element = element->next) {
+            if (!match_proc_text(element, text)) continue;
+            if (count < size) matches[count] = element;
+            count += 1;
+        }
+
+        return count;
+    }
+
+    unsigned int *cursors = buckets + length - 2;
+    unsigned int buckets_length = 0;
+
+    for (size_t position = 0; position + 2 < length; position += 1) {
+        unsigned int bucket = hash_trigram(text + position);
+        unsigned int insert = 0;
+
+        while (insert < buckets_length && buckets[insert] != bucket) insert += 1;
+        if (insert < buckets_length) continue;
+
+        while (insert > 0 && trigrams->buckets[buckets[insert - 1]].length > trigrams->buckets[bucket].length) {
+            buckets[insert] = buckets[insert - 1];
+            insert -= 1;
+        }
+
+        buckets[insert] = bucket;
+        cursors[buckets_length++] = 0;
+    }
+
+    TrigramPostings *shortest = &trigrams->buckets[buckets[0]];
+    for (unsigned int position = 0; position < shortest->length; position += 1) {
+        unsigned int id = shortest->ids[position];
+        ProcessElementList *element = trigrams->elements[id];
+        unsigned int bucket = 1;
+
+        for (; bucket < buckets_length; bucket += 1) {
+            TrigramPostings *postings = &trigrams->buckets[buckets[bucket]];
+            cursors[bucket] = seek_postings(postings, cursors[bucket], id);
+            if (cursors[bucket] == postings->length) position = shortest->length;
+            if (cursors[bucket] == postings->length || postings->ids[cursors[bucket]] != id) break;
+        }
+
+        if (bucket < buckets_length || element == NULL || !match_proc_text(element, text)) continue;
+        if (count < size) matches[count] = element;
+        count += 1;
+    }
+
+    free(buckets);
+    return count;
+}
+
+/*
+  * This function enables the string intern table: strings set by set_proc_strings
+  * are owned by the list, deduplicated (equal strings are equal pointers)
+  * and freed with the last process using them or with the list.
+  * This function returns 1 if malloc failed.
+*/
+char enable_proc_strings(StartProcList *list) {
+    if (list->strings != NULL) return 0;
+
+    list->strings = create_strings();
+    return list->strings == NULL;
+}
+
+/*
+  * This function sets the strings of a process like set_proc_strings, a
+  * user_interned user is already in the list table (only a reference is
+  * taken, the name is not hashed again).
+  * This function returns 1 if malloc failed.
+*/
+static char assign_proc_strings(StartProcList *list, ProcessElementList *element, const char *executable, const char *cmdline, const char *user, char user_interned) {
+    if (enable_proc_strings(list)) return 1;
+
+    char *values[3] = {NULL, NULL, NULL};
+    const char *sources[3] = {executable, cmdline, user};
+
+    for (unsigned int field = 0; field < 3; field += 1) {
+        if (sources[field] == NULL) continue;
+        if (field == 2 && user_interned) {
+            values[field] = (char *)user;
+            ((InternedString *)(values[field] - offsetof(InternedString, value)))->references += 1;
+            continue;
+        }
+        values[field] = intern_string(list->strings, sources[field], strlen(sources[field]));
+
+        if (values[field] == NULL) {
+            while (field) release_string(list->strings, values[--field]);
+            return 1;
+        }
+    }
+
+    if (!owns_proc(list, element)) element->flags &= ~PROC_FLAG_INTERNED;
+    release_proc_strings(list, element);
+    element->executable = values[0];
+    element->cmdline = values[1];
+    element->user = values[2];
+    element->flags |= PROC_FLAG_INTERNED;
+
+    if (untrigram_proc(list, element)) trigram_proc(list, element);
+    return 0;
+}
+
+/*
+  * This function sets executable, cmdline and user (NULL allowed) of a process
+  * with interned copies, previous interned strings of the process are released
+  * (for processes not allocated by new_proc they are released with the list).
+  * The string table is enabled if needed.
+  * This function returns 1 if malloc failed.
+*/
+char set_proc_strings(StartProcList *list, ProcessElementList *element, const char *executable, const char *cmdline, const char *user) {
+    return assign_proc_strings(list, element, executable, cmdline, user, 0);
+}
+
+/*
+  * This function returns the number of distinct strings owned by the list.
+*/
+unsigned int count_proc_strings(StartProcList *list) {
+    if (list->strings == NULL) return 0;
+    return list->strings->length;
+}
+
+/*
+  * This function reads /proc and adds each running process at the end of the list,
+  * strings are interned in the list string table (enabled if needed).
+  * Processes are new so cpu_usage is 0, refresh_procs computes it between scans.
+  * This function returns 1 if /proc cannot be read or malloc failed.
+*/
+char scan_procs(StartProcList *list) {
+    return scan_procs_fields(list, PROC_FIELD_ALL);
+}
+
+/*
+  * This function reads /proc like scan_procs but only reads the strings of
+  * the fields mask (PROC_FIELD_* bits, 0: only stat values), others are
+  * loaded on first access by get_proc_executable, get_proc_cmdline and
+  * get_proc_user. The mask is also used by next refresh_procs.
+  * This function returns 1 if /proc cannot be read or malloc failed.
+*/
+char scan_procs_fields(StartProcList *list, unsigned char fields) {
+    ProcScanner *scanner = get_scanner(list);
+    if (scanner == NULL || enable_proc_strings(list)) return 1;
+
+    scanner->fields = fields & PROC_FIELD_ALL;
+
+    sample_total_time(scanner);
+    check_users(scanner, list->strings);
+    scanner->elapsed = 0;
+    rewinddir(scanner->directory);
+    ProcessElementList *element = NULL;
+    struct dirent *entry;
+    ProcStat stat;
+
+    while ((entry = readdir(scanner->directory)) != NULL) {
+        if (entry->d_name[0] < '1' || entry->d_name[0] > '9') continue;
+        unsigned int pid = strtoul(entry->d_name, NULL, 10);
+        if (read_proc_stat(scanner, pid, &stat)) continue;
+
+        if (element == NULL) element = new_proc(list);
+        if (element == NULL) return 1;
+
+        if (read_proc(list, scanner, pid, &stat, element) == 0) {
+            add_proc(list, element);
+            element = NULL;
+        }
+    }
+
+    if (element != NULL) free_proc(list, element);
+    return 0;
+}
+
+/*
+  * This function reads the threads of a process from /proc/<pid>/task and
+  * replaces its thread records. Records come from the list thread pool:
+  * threads are only read for processes the caller asks about.
+  * A PID reused by another process (different start time) counts as exited.
+  * This function returns 1 if the process has exited or malloc failed.
+*/
+char load_proc_threads(StartProcList *list, ProcessElementList *element) {
+    ProcScanner *scanner = get_scanner(list);
+    ProcStat stat;
+    if (scanner == NULL || read_proc_stat(scanner, element->pid, &stat) || get_start_timestamp(scanner, &stat) != element->start_timestamp) return 1;
+
+    if (list->thread_pool == NULL) {
+        list->thread_pool = create_pool(sizeof(ProcThread), 0);
+        if (list->thread_pool == NULL) return 1;
+    }
+
+    snprintf(scanner->path, sizeof(scanner->path), "%u/task", element->pid);
+    int task_fd = openat(scanner->proc_fd, scanner->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (task_fd < 0) return 1;
+
+    DIR *directory = fdopendir(task_fd);
+    if (directory == NULL) {
+        close(task_fd);
+        return 1;
+    }
+
+    free_proc_threads(list, element);
+    element->flags |= PROC_FLAG_THREADS;
+
+    ProcThread **next = &element->threads;
+    struct dirent *entry;
+    char error = 0;
+
+    while ((entry = readdir(directory)) != NULL) {
+        if (entry->d_name[0] < '1' || entry->d_name[0] > '9') continue;
+
+        unsigned int tid = strtoul(entry->d_name, NULL, 10);
+        snprintf(scanner->path, sizeof(scanner->path), "%u/task/%u/stat", element->pid, tid);
+        if (read_scanner_file(scanner, scanner->proc_fd, scanner->path) < 0 || parse_proc_stat(scanner, &stat)) continue;
+
+        ProcThread *thread = allocate_pool_item(list->thread_pool);
+        if (thread == NULL) {
+            error = 1;
+            break;
+        }
+
+        thread->tid = tid;
+        thread->state = stat.state;
+        thread->cpu_time = stat.utime + stat.stime;
+        thread->processor = stat.processor;
+        *next = thread;
+        next = &thread->next;
+    }
+
+    closedir(directory);
+    return error;
+}
+
+/*
+  * This function releases the thread records of a process.
+*/
+void free_proc_threads(StartProcList *list, ProcessElementList *element) {
+    if (list->thread_pool == NULL || !(element->flags & PROC_FLAG_THREADS)) return;
+
+    ProcThread *thread = element->threads;
+    while (thread != NULL) {
+        ProcThread *next = thread->next;
+        release_pool_item(list->thread_pool, thread);
+        thread = next;
+    }
+
+    element->threads = NULL;
+    element->flags &= ~PROC_FLAG_THREADS;
+}
+
+/*
+  * This function returns the number of loaded threads of a process.
+*/
+unsigned int count_proc_threads(ProcessElementList *element) {
+    unsigned int count = 0;
+    if (!(element->flags & PROC_FLAG_THREADS)) return 0;
+
+    for (ProcThread *thread = element->threads; thread != NULL; thread = thread->next) count += 1;
+    return count;
+}
+
+/*
+  * This function loads the pending strings of the fields mask (PROC_FIELD_*
+  * bits), for example only for processes selected by a filter.
+  * This function returns 1 if the process has exited or malloc failed.
+*/
+char load_proc_fields(StartProcList *list, ProcessElementList *element, unsigned char fields) {
+    fields &= element->flags >> PROC_FLAG_PENDING_SHIFT;
+    if (fields == 0) return 0;
+
+    ProcScanner *scanner = get_scanner(list);
+    ProcStat stat;
+    if (scanner == NULL || read_proc_stat(scanner, element->pid, &stat) || get_start_timestamp(scanner, &stat) != element->start_timestamp) return 1;
+
+    if (fields & PROC_FIELD_USER) check_users(scanner, list->strings);
+    return read_proc_fields(list, scanner, element->pid, &stat, element, fields);
+}
+
+/*
+  * This function returns the executable of a process, loaded on first access.
+  * This function returns NULL if the process has exited before loading it.
+*/
+char *get_proc_executable(StartProcList *list, ProcessElementList *element) {
+    load_proc_fields(list, element, PROC_FIELD_EXECUTABLE);
+    return element->executable;
+}
+
+/*
+  * This function returns the command line of a process, loaded on first access.
+  * This function returns NULL if the process has exited before loading it.
+*/
+char *get_proc_cmdline(StartProcList *list, ProcessElementList *element) {
+    load_proc_fields(list, element, PROC_FIELD_CMDLINE);
+    return element->cmdline;
+}
+
+/*
+  * This function returns the user of a process, loaded on first access.
+  * This function returns NULL if the process has exited before loading it.
+*/
+char *get_proc_user(StartProcList *list, ProcessElementList *element) {
+    load_proc_fields(list, element, PROC_FIELD_USER);
+    return element->user;
+}
+
+/*
+  * This function returns the user name of a UID from the list cache shared
+  * by scans (invalidated when /etc/passwd is modified), unknown UIDs are
+  * returned in decimal. The name is valid until the next scan or lookup.
+  * This function returns NULL if /proc cannot be opened or malloc failed.
+*/
+const char *resolve_proc_user(StartProcList *list, unsigned int uid) {
+    ProcScanner *scanner = get_scanner(list);
+    if (scanner == NULL) return NULL;
+
+    check_users(scanner, list->strings);
+    return resolve_user(scanner, uid);
+}
+
+typedef struct ScanShard {
+    StartProcList *list;             // private list sharing the list pool, with its own string table
+    ProcScanner scanner;             // copy of the list scanner with its own buffer
+    unsigned int *pids;
+    ProcessElementList **nodes;      // nodes reserved in the list pool, one by PID
+    unsigned int length;
+    unsigned int used;               // reserved nodes added to the private list
+} ScanShard;
+
+/*
+  * This function compares two PIDs for qsort.
+*/
+static int compare_pid(const void *first, const void *second) {
+    unsigned int first_pid = *(const unsigned int *)first;
+    unsigned int second_pid = *(const unsigned int *)second;
+    return (first_pid > second_pid) - (first_pid < second_pid);
+}
+
+/*
+  * This function moves the strings of a process from the private table of a
+  * shard to the list table, so equal strings of all shards share one copy.
+  * This function returns 1 if malloc failed (the process keeps its strings).
+*/
+static char move_shard_strings(StartProcList *list, StartProcList *shard_list, ProcessElementList *element) {
+    if (!(element->flags & PROC_FLAG_INTERNED)) return 0;
+
+    char *values[3] = {element->executable, element->cmdline, element->user};
+    for (unsigned int field = 0; field < 3; field += 1) {
+        if (values[field] == NULL) continue;
+        values[field] = intern_string(list->strings, values[field], strlen(values[field]));
+
+        if (values[field] == NULL) {
+            while (field) release_string(list->strings, values[--field]);
+            return 1;
+        }
+    }
+
+    release_proc_strings(shard_list, element);
+    element->executable = values[0];
+    element->cmdline = values[1];
+    element->user = values[2];
+    element->flags |= PROC_FLAG_INTERNED;
+    return 0;
+}
+
+/*
+  * This function reads the processes of a shard in its private list,
+  * nodes are taken from the reserved ones (the pool is not touched by threads).
+*/
+static void *scan_shard(void *data) {
+    ScanShard *shard = data;
+    ProcStat stat;
+
+    for (unsigned int position = 0; position < shard->length; position += 1) {
+        if (read_proc_stat(&shard->scanner, shard->pids[position], &stat)) continue;
+
+        ProcessElementList *element = shard->nodes[shard->used];
+        if (read_proc(shard->list, &shard->scanner, shard->pids[position], &stat, element) == 0) {
+            add_proc(shard->list, element);
+            shard->used += 1;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+  * This function reads /proc like scan_procs with threads (0: one by CPU):
+  * the sorted PID listing is split in contiguous ranges, one node by PID is
+  * reserved in the list pool, each thread fills a private list (sharing the
+  * pool, with its own string table) and the lists are spliced at the end of
+  * the list in PID order, their strings interned in the list table. Unused
+  * nodes go back to the pool, so repeated scans reuse the nodes of removed
+  * processes.
+  * This function returns 1 if /proc cannot be read or malloc failed.
+*/
+char scan_procs_parallel(StartProcList *list, unsigned int threads) {
+    ProcScanner *scanner = get_scanner(list);
+    if (scanner == NULL || enable_proc_strings(list) || enable_proc_pool(list, 0)) return 1;
+
+    scanner->fields = PROC_FIELD_ALL;
+    sample_total_time(scanner);
+    check_users(scanner, list->strings);
+    scanner->elapsed = 0;
+    rewinddir(scanner->directory);
+
+    unsigned int length = 0, size = 1024;
+    unsigned int *pids = malloc(size * sizeof(unsigned int));
+    if (pids == NULL) return 1;
+
+    struct dirent *entry;
+    while ((entry = readdir(scanner->directory)) != NULL) {
+        if (entry->d_name[0] < '1' || entry->d_name[0] > '9') continue;
+
+        if (length == size) {
+            unsigned int *new_pids = realloc(pids, size * 2 * sizeof(unsigned int));
+            if (new_pids == NULL) {
+                free(pids);
+                return 1;
+            }
+            pids = new_pids;
+            size *= 2;
+        }
+
+        pids[length++] = strtoul(entry->d_name, NULL, 10);
+    }
+
+    qsort(pids, length, sizeof(unsigned int), compare_pid);
+
+    if (threads == 0) threads = scanner->cpu_count ? scanner->cpu_count : 1;
+    if (threads > length) threads = length ? length : 1;
+
+    ScanShard *shards = calloc(threads, sizeof(ScanShard));
+    pthread_t *workers = malloc(threads * sizeof(pthread_t));
+    char *started = calloc(threads, sizeof(char));
+    ProcessElementList **nodes = malloc((length ? length : 1) * sizeof(ProcessElementList *));
+    unsigned int reserved = 0;
+    char error = shards == NULL || workers == NULL || started == NULL || nodes == NULL;
+
+    // reserved before any thread starts: workers never allocate from the shared pool
+    while (!error && reserved < length) {
+        nodes[reserved] = allocate_pool_item(list->pool);
+        if (nodes[reserved] == NULL) error = 1;
+        else reserved += 1;
+    }
+
+    if (error && nodes != NULL) {
+        for (unsigned int index = 0; index < reserved; index += 1) release_pool_item(list->pool, nodes[index]);
+    }
+
+    for (unsigned int position = 0; position < threads && !error; position += 1) {
+        ScanShard *shard = &shards[position];
+        unsigned int first = (unsigned long long)length * position / threads;
+
+        shard->pids = pids + first;
+        shard->nodes = nodes + first;
+        shard->length = (unsigned long long)length * (position + 1) / threads - first;
+    }
+
+    for (unsigned int position = 0; position < threads && !error; position += 1) {
+        ScanShard *shard = &shards[position];
+        shard->scanner = *scanner;
+        shard->scanner.buffer = NULL;
+        shard->scanner.users = NULL;                     // private caches, the list cache is not thread safe
+        shard->scanner.users_length = 0;
+        shard->scanner.users_size = 0;
+
+        shard->list = malloc(sizeof(StartProcList));
+        if (shard->list == NULL) {
+            error = 1;
+            break;
+        }
+
+        init_proc_list(shard->list);
+        shard->list->pool = list->pool;
+        list->pool->references += 1;
+        shard->scanner.buffer = malloc(SCANNER_BUFFER_SIZE);
+        shard->scanner.buffer_size = SCANNER_BUFFER_SIZE;
+        if (shard->scanner.buffer == NULL || enable_proc_strings(shard->list)) error = 1;
+    }
+
+    for (unsigned int position = 0; position < threads && !error; position += 1) {
+        started[position] = pthread_create(&workers[position], NULL, scan_shard, &shards[position]) == 0;
+        if (!started[position]) scan_shard(&shards[position]);  // no thread available: scan it here
+    }
+
+    for (unsigned int position = 0; position < threads && shards != NULL && started != NULL; position += 1) {
+        ScanShard *shard = &shards[position];
+        if (started[position]) pthread_join(workers[position], NULL);
+
+        if (shard->list != NULL) {
+            // unused nodes may hold strings of the private table
+            for (unsigned int index = shard->used; index < shard->length; index += 1) free_proc(shard->list, shard->nodes[index]);
+            for (ProcessElementList *element = shard->list->first; element != NULL && !error; element = element->next) error = move_shard_strings(list, shard->list, element);
+            if (!error) error = splice_proc_list(list, shard->list, list->last);
+            clear_users(&shard->scanner, shard->list->strings);
+            clean_proc_list(shard->list);
+        } else if (shard->nodes != NULL) {
+            for (unsigned int index = 0; index < shard->length; index += 1) release_pool_item(list->pool, shard->nodes[index]);
+        }
+
+        free(shard->scanner.buffer);
+        clear_users(&shard->scanner, NULL);               // names of shards without a list
+        free(shard->scanner.users);
+    }
+
+    free(started);
+    free(workers);
+    free(shards);
+    free(nodes);
+    free(pids);
+    return error;
+}
+
+/*
+  * This function free each processus and free the StartProcList memory.
+  * Pooled processes and interned strings are not freed one by one,
+  * chunks and string table are released at once (unless they are shared
+  * with another list, then processes are released one by one).
+*/
+void clean_proc_list(StartProcList *list) {
+    ProcessElementList *element = list->first;
+    ProcessElementList *new_element;
+    char shared = (list->pool != NULL && list->pool->references > 1) || (list->strings != NULL && list->strings->references > 1) || (list->thread_pool != NULL && list->thread_pool->references > 1);
+
+    while (element != NULL) {
+        new_element = element->next;
+        if (shared) {
+            free_proc(list, element);
+        } else if (list->pool == NULL || !pool_owns(list->pool, element)) {
+            free(element);
+        }
+        element = new_element;
+    }
+
+    if (list->pool != NULL) destroy_pool(list->pool);
+    if (list->scanner != NULL) destroy_scanner(list->scanner, list->strings);   // before its interned user names
+    if (list->strings != NULL) destroy_strings(list->strings);
+    if (list->positions != NULL) destroy_positions(list->positions);
+    if (list->thread_pool != NULL) destroy_pool(list->thread_pool);
+    if (list->trigrams != NULL) destroy_trigrams(list->trigrams);
+
+    if (list->index != NULL) {
+        free(list->index->slots);
+        free(list->index);
+    }
+
+    free(list);
+}
+
+/*
+  * This function adds a process in the list.
+*/
+void add_proc(StartProcList *list, ProcessElementList *element) {
+    element->next = NULL;
+
+    if (list->last == NULL) {
+        element->precedent = NULL;
+        list->first = element;
+        list->position = element;
+    } else {
+        list->last->next = element;
+        element->precedent = list->last;
+    }
+    
+    list->length += 1;
+    list->last = element;
+    attach_proc(list, element);
+}
+
+/*
+  * This function unlinks a process from the list without freeing it.
+*/
+static void unlink_proc(StartProcList *list, ProcessElementList *element) {
+    detach_proc(list, element);
+
+    if (element->next != NULL) {
+        element->next->precedent = element->precedent;
+    } else {
+        list->last = element->precedent;
+    }
+
+    if (element->precedent != NULL) {
+        element->precedent->next = element->next;
+    } else {
+        list->first = element->next;
+    }
+
+    if (list->position == element) list->position = element->next;
+    list->length -= 1;
+}
+
+/*
+  * This function returns and delete the last process.
+  * This function returns NULL if last element is not defined.
+*/
+ProcessElementList *pop_proc(StartProcList *list) {
+    if (list->last == NULL) {
+        return NULL;
+    }
+
+    ProcessElementList *last = list->last;
+    unlink_proc(list, last);
+    return last;
+}
+
+/*
+  * This function returns and delete the first process.
+  * This function returns NULL if the first process is not defined.
+*/
+ProcessElementList *popleft_proc(StartProcList *list) {
+    if (list->first == NULL) {
+        return NULL;
+    }
+    
+    ProcessElementList *first = list->first;
+    unlink_proc(list, first);
+    return first;
+}
+
+/*
+  * This function inserts a process in specific position.
+  * Return 1 if index is greater than list length.
+*/
+char insert_proc(StartProcList *list, ProcessElementList *new_element, unsigned int index) {
+    if (index > list->length) {
+        return 1;
+    } else if (index == list->length) {
+        add_proc(list, new_element);
+    } else {
+        ProcessElementList *element = find_proc_index(list, index);
+
+        if (element->precedent != NULL) {
+            element->precedent->next = new_element;
+            new_element->precedent = element->precedent;
+        } else {
+        	list->first = new_element;
+        	new_element->precedent = NULL;
+        }
+
+        element->precedent = new_element;
+        new_element->next = element;
+        list->length += 1;
+        attach_proc(list, new_element);
+    }
+    
+    return 0;
+}
+
+/*
+  * This function inserts a process after a specific process.
+*/
+void insert_after_proc(StartProcList *list, ProcessElementList *new_element, ProcessElementList *before) {
+    new_element->next = before->next;
+    new_element->precedent = before;
+    
+    if (before->next != NULL) {
+        before->next->precedent = new_element;
+    }
+
+    before->next = new_element;
+    if (list->last == before) list->last = new_element;
+    list->length += 1;
+    attach_proc(list, new_element);
+}
+
+/*
+  * This function inserts a process before a specific process.
+*/
+void insert_before_proc(StartProcList *list, ProcessElementList *new_element, ProcessElementList *after) {
+    new_element->precedent = after->precedent;
+    new_element->next = after;
+
+    if (after->precedent != NULL) {
+        after->precedent->next = new_element;
+    }
+
+    after->precedent = new_element;
+    if (list->first == after) list->first = new_element;
+    list->length += 1;
+    attach_proc(list, new_element);
+}
+
+/*
+  * This function adds count processes at the end of the list. Without
+  * PID or positional index the nodes are linked in one pass and the
+  * list length and last process are updated once.
+*/
+void add_procs(StartProcList *list, ProcessElementList **elements, unsigned int count) {
+    if (count == 0) return;
+
+    if (has_proc_indexes(list)) {
+        for (unsigned int position = 0; position < count; position += 1) add_proc(list, elements[position]);
+        return;
+    }
+
+    ProcessElementList *precedent = list->last;
+    for (unsigned int position = 0; position < count; position += 1) {
+        ProcessElementList *element = elements[position];
+        element->precedent = precedent;
+        if (element->flags && !owns_proc(list, element)) element->flags = 0;
+
+        if (precedent != NULL) {
+            precedent->next = element;
+        } else {
+            list->first = element;
+            list->position = element;
+        }
+
+        precedent = element;
+    }
+
+    precedent->next = NULL;
+    list->last = precedent;
+    list->length += count;
+}
+
+/*
+  * This function moves the pool chunks of other into the list pool in O(1),
+  * processes allocated by other can then be freed by the list.
+*/
+static void adopt_pool(ProcPool *pool, ProcPool *other) {
+    if (other->chunks == NULL) return;
+
+    if (pool->chunks == NULL) {
+        pool->chunks = other->chunks;
+        pool->oldest = other->oldest;
+        pool->cursor = other->cursor;
+        pool->free_items = other->free_items;
+        pool->last_free = other->last_free;
+    } else {
+        if (other->cursor < other->chunks->end) {      // unused end of the newest chunk: one free run
+            PoolRun *run = (PoolRun *)other->cursor;
+            run->next = other->free_items;
+            run->end = other->chunks->end;
+            if (other->free_items == NULL) other->last_free = run;
+            other->free_items = run;
+        }
+
+        other->oldest->next = pool->chunks->next;      // the list newest chunk stays first, cursor stays valid
+        pool->chunks->next = other->chunks;
+        if (pool->oldest == pool->chunks) pool->oldest = other->oldest;
+
+        if (other->free_items != NULL) {
+            other->last_free->next = pool->free_items;
+            if (pool->free_items == NULL) pool->last_free = other->last_free;
+            pool->free_items = other->free_items;
+        }
+    }
+
+    other->chunks = NULL;
+    other->oldest = NULL;
+    other->cursor = NULL;
+    other->free_items = NULL;
+    other->last_free = NULL;
+}
+
+/*
+  * This function moves the interned strings of other into the list table,
+  * O(strings of other). Strings interned by both tables keep two copies
+  * until their processes are freed.
+*/
+static void adopt_strings(ProcStrings *strings, ProcStrings *other) {
+    for (unsigned int bucket = 0; bucket < other->size; bucket += 1) {
+        InternedString *entry = other->buckets[bucket];
+
+        while (entry != NULL) {
+            InternedString *next = entry->next;
+            entry->next = strings->buckets[entry->hash & (strings->size - 1)];
+            strings->buckets[entry->hash & (strings->size - 1)] = entry;
+            strings->length += 1;
+            if (strings->length >= strings->size) grow_strings(strings);
+            entry = next;
+        }
+
+        other->buckets[bucket] = NULL;
+    }
+
+    other->length = 0;
+}
+
+/*
+  * This function makes two lists use the same pool, the items of a pool
+  * only used by one list are moved into the other pool.
+*/
+static void share_pool(ProcPool **pool, ProcPool **other) {
+    if (*other == *pool) return;
+
+    if (*other == NULL || *pool == NULL) {
+        if (*pool == NULL) *pool = *other;
+        else *other = *pool;
+        (*pool)->references += 1;
+        return;
+    }
+
+    if ((*other)->references == 1) {
+        adopt_pool(*pool, *other);
+        destroy_pool(*other);
+        *other = *pool;
+    } else {
+        adopt_pool(*other, *pool);
+        destroy_pool(*pool);
+        *pool = *other;
+    }
+
+    (*pool)->references += 1;
+}
+
+/*
+  * This function makes two lists use the same string table, the strings
+  * of a table only used by one list are moved into the other table.
+*/
+static void share_strings(ProcStrings **strings, ProcStrings **other) {
+    if (*other == *strings) return;
+
+    if (*other == NULL || *strings == NULL) {
+        if (*strings == NULL) *strings = *other;
+        else *other = *strings;
+        (*strings)->references += 1;
+        return;
+    }
+
+    // the smaller table is moved when both are only used by these lists
+    if ((*other)->references == 1 && ((*strings)->references > 1 || (*other)->length <= (*strings)->length)) {
+        adopt_strings(*strings, *other);
+        destroy_strings(*other);
+        *other = *strings;
+    } else {
+        adopt_strings(*other, *strings);
+        destroy_strings(*strings);
+        *strings = *other;
+    }
+
+    (*strings)->references += 1;
+}
+
+/*
+  * This function makes two lists share their node pool, thread pool and
+  * string table, so processes can move between them and each list can be
+  * cleaned first. Resources already shared by both lists with other lists
+  * cannot be merged.
+  * This function returns 1 if the resources cannot be shared (nothing is changed).
+*/
+static char share_proc_resources(StartProcList *list, StartProcList *other) {
+    if (list->pool != NULL && other->pool != NULL && list->pool != other->pool && list->pool->references > 1 && other->pool->references > 1) return 1;
+    if (list->thread_pool != NULL && other->thread_pool != NULL && list->thread_pool != other->thread_pool && list->thread_pool->references > 1 && other->thread_pool->references > 1) return 1;
+    if (list->strings != NULL && other->strings != NULL && list->strings != other->strings && list->strings->references > 1 && other->strings->references > 1) return 1;
+
+    if (list->pool != NULL || other->pool != NULL) share_pool(&list->pool, &other->pool);
+    if (list->thread_pool != NULL || other->thread_pool != NULL) share_pool(&list->thread_pool, &other->thread_pool);
+    if (list->strings != NULL || other->strings != NULL) share_strings(&list->strings, &other->strings);
+    return 0;
+}
+
+/*
+  * This function clears the PID, positional and trigram indexes of an emptied list.
+*/
+static void clear_proc_indexes(StartProcList *list) {
+    if (list->index != NULL) {
+        memset(list->index->slots, 0, list->index->size * sizeof(PidIndexSlot));
+        list->index->length = 0;
+    }
+
+    if (list->positions != NULL) {
+        for (unsigned int position = 0; position < list->positions->length; position += 1) free(list->positions->chunks[position]);
+        list->positions->length = 0;
+    }
+
+    if (list->trigrams != NULL) {
+        for (unsigned int bucket = 0; bucket < TRIGRAM_BUCKETS; bucket += 1) list->trigrams->buckets[bucket].length = 0;
+        list->trigrams->length = 1;
+        list->trigrams->removed = 0;
+    }
+}
+
+/*
+  * This function moves every process of other after a process of the list
+  * (NULL: at the beginning), other is empty and still usable after the call.
+  * Both lists share their pools and string table afterwards: pool chunks
+  * are moved in O(1), the strings of the smaller table are moved into the
+  * other one, O(s) for s strings (nothing when the table is already shared).
+  * Without optional index the links are updated in O(1); with PID,
+  * positional or trigram index each moved process is indexed, O(k) for
+  * k moved processes whatever the list length.
+  * This function returns 1 if both lists share their pools or string table
+  * with other lists (nothing is moved).
+*/
+char splice_proc_list(StartProcList *list, StartProcList *other, ProcessElementList *before) {
+    if (other->first == NULL) return 0;
+    if (share_proc_resources(list, other)) return 1;
+
+    ProcessElementList *first = other->first;
+    ProcessElementList *last = other->last;
+    unsigned int length = other->length;
+
+    other->first = NULL;
+    other->last = NULL;
+    other->position = NULL;
+    other->length = 0;
+    clear_proc_indexes(other);
+
+    if (has_proc_indexes(list)) {
+        ProcessElementList *element = first;
+
+        while (element != NULL) {
+            ProcessElementList *next = element->next;
+
+            if (before != NULL) {
+                insert_after_proc(list, element, before);
+            } else if (list->first != NULL) {
+                insert_before_proc(list, element, list->first);
+            } else {
+                add_proc(list, element);
+            }
+
+            before = element;
+            element = next;
+        }
+
+        return 0;
+    }
+
+    ProcessElementList *after = before != NULL ? before->next : list->first;
+    if (list->first == NULL) list->position = first;
+    first->precedent = before;
+    last->next = after;
+
+    if (before != NULL) {
+        before->next = first;
+    } else {
+        list->first = first;
+    }
+
+    if (after != NULL) {
+        after->precedent = last;
+    } else {
+        list->last = last;
+    }
+
+    list->length += length;
+    return 0;
+}
+
+/*
+  * This function moves a process and all following processes at the end
+  * of other. Both lists share their pools and string table afterwards,
+  * so they can be cleaned in any order.
+  * This function returns 1 if both lists share their pools or string table
+  * with other lists (nothing is moved).
+*/
+char split_proc_list(StartProcList *list, ProcessElementList *element, StartProcList *other) {
+    if (share_proc_resources(list, other)) return 1;
+
+    ProcessElementList *last = list->last;
+    unsigned int length = 0;
+
+    for (ProcessElementList *moved = element; moved != NULL; moved = moved->next) {
+        if (list->position == moved) list->position = NULL;
+        detach_proc(list, moved);
+        length += 1;
+    }
+
+    if (element->precedent != NULL) {
+        element->precedent->next = NULL;
+    } else {
+        list->first = NULL;
+    }
+
+    list->last = element->precedent;
+    list->length -= length;
+
+    if (has_proc_indexes(other)) {
+        while (element != NULL) {
+            ProcessElementList *next = element->next;
+            add_proc(other, element);
+            element = next;
+        }
+
+        return 0;
+    }
+
+    element->precedent = other->last;
+    if (other->last != NULL) {
+        other->last->next = element;
+    } else {
+        other->first = element;
+        other->position = element;
+    }
+
+    other->last = last;
+    other->length += length;
+    return 0;
+}
+
+/*
+  * This function removes and free a process at a specific position.
+  * This function returns 1 if index is greater or equal than list length.
+*/
+char remove_proc_index(StartProcList *list, unsigned int index) {
+    if (list->length <= index) {
+        return 1;
+    }
+
+    ProcessElementList *element = find_proc_index(list, index);
+    unlink_proc(list, element);
+    free_proc(list, element);
+    return 0;
+}
+
+/*
+  * This function removes and free a specific process.
+*/
+void remove_proc(StartProcList *list, ProcessElementList *element) {
+    unlink_proc(list, element);
+    free_proc(list, element);
+}
+
+/*
+  * This function returns the next process.
+  * This function returns NULL if the list position is greater than the last process position.
+*/
+ProcessElementList *get_next_proc(StartProcList *list) {
+    if (list->position == NULL) {
+        return NULL;
+    }
+    ProcessElementList *process = list->position;
+    list->position = process->next;
+    return process;
+}
+
+/*
+  * This function returns the precedent process.
+  * This function returns NULL if the list position is smaller than the first process position.
+*/
+ProcessElementList *get_precedent_proc(StartProcList *list) {
+    if (list->position == NULL) {
+        return NULL;
+    }
+    
+    ProcessElementList *process = list->position;
+    list->position = process->precedent;
+    return process;
+}
+
+/*
+  * This function returns a process by index.
+  * This function returns NULL if index is greater or equal than list length.
+*/
+ProcessElementList *get_proc(StartProcList *list, unsigned int index) {
+    if (index >= list->length) {
+        return NULL;
+    }
+
+    return find_proc_index(list, index);
+}
+
+/*
+  * This function returns a process by PID.
+  * This function returns NULL if PID is not found.
+*/
+ProcessElementList *get_proc_pid(StartProcList *list, unsigned int pid) {
+    ProcPidIndex *index = list->index;
+
+    if (index != NULL) {
+        unsigned int mask = index->size - 1;
+        unsigned int slot = hash_pid(index, pid);
+
+        while (index->slots[slot].element != NULL) {
+            if (index->slots[slot].pid == pid) return index->slots[slot].element;
+            slot = (slot + 1) & mask;
+        }
+
+        return NULL;
+    }
+
+    ProcessElementList *element = list->first;
+    while (element != NULL && element->pid != pid) element = element->next;
+    if (element == NULL) return NULL;
+    return element;
+}
+
+/*
+  * This function places list on the first position.
+*/
+void goto_first_position (StartProcList *list) {
+    list->position = list->first;
+}
+
+/*
+  * This function places list on the last position.
+*/
+void goto_last_position (StartProcList *list) {
+    list->position = list->last;
+}
+
+/*
+  * This function compares processes by PID (ascending).
+*/
+int compare_proc_pid(const ProcessElementList *first, const ProcessElementList *second) {
+    return (first->pid > second->pid) - (first->pid < second->pid);
+}
+
+/*
+  * This function compares processes by start timestamp (oldest first).
+*/
+int compare_proc_start_timestamp(const ProcessElementList *first, const ProcessElementList *second) {
+    return (first->start_timestamp > second->start_timestamp) - (first->start_timestamp < second->start_timestamp);
+}
+
+/*
+  * This function compares processes by CPU usage (heaviest first).
+*/
+int compare_proc_cpu_usage(const ProcessElementList *first, const ProcessElementList *second) {
+    return (first->cpu_usage < second->cpu_usage) - (first->cpu_usage > second->cpu_usage);
+}
+
+/*
+  * This function compares processes by memory usage (heaviest first).
+*/
+int compare_proc_memory_usage(const ProcessElementList *first, const ProcessElementList *second) {
+    return (first->memory_usage < second->memory_usage) - (first->memory_usage > second->memory_usage);
+}
+
+/*
+  * This function sorts the list in place with a stable bottom-up merge sort
+  * that relinks processes without allocation (O(n log n)).
+  * The positional index is rebuilt, the PID index is not affected.
+*/
+void sort_proc_list(StartProcList *list, ProcCompare compare) {
+    ProcessElementList *head = list->first;
+    if (head == NULL) return;
+
+    for (unsigned int width = 1;; width *= 2) {
+        ProcessElementList *left = head, *tail = NULL;
+        unsigned int merges = 0;
+        head = NULL;
+
+        while (left != NULL) {
+            merges += 1;
+            ProcessElementList *right = left;
+            unsigned int left_length = 0, right_length = width;
+            while (left_length < width && right != NULL) {
+                left_length += 1;
+                right = right->next;
+            }
+
+            while (left_length || (right_length && right != NULL)) {
+                ProcessElementList *element;
+
+                if (left_length && (!right_length || right == NULL || compare(left, right) <= 0)) {
+                    element = left;
+                    left = left->next;
+                    left_length -= 1;
+                } else {
+                    element = right;
+                    right = right->next;
+                    right_length -= 1;
+                }
+
+                if (tail != NULL) tail->next = element; else head = element;
+                tail = element;
+            }
+
+            left = right;
+        }
+
+        tail->next = NULL;
+        if (merges <= 1) break;
+    }
+
+    ProcessElementList *precedent = NULL;
+    for (ProcessElementList *element = head; element != NULL; element = element->next) {
+        element->precedent = precedent;
+        precedent = element;
+    }
+
+    list->first = head;
+    list->last = precedent;
+
+    if (list->positions != NULL) {
+        destroy_positions(list->positions);
+        list->positions = NULL;
+        enable_proc_positions(list);
+    }
+}
+
+/*
+  * This function sorts an array with a stable bottom-up merge sort, temp
+  * must have the same length. The result is in items.
+*/
+static void sort_proc_array(ProcessElementList **items, ProcessElementList **temp, unsigned int length, ProcCompare compare) {
+    ProcessElementList **source = items, **destination = temp;
+
+    for (unsigned int width = 1; width < length; width *= 2) {
+        for (unsigned int start = 0; start < length; start += 2 * width) {
+            unsigned int middle = start + width < length ? start + width : length;
+            unsigned int end = middle + width < length ? middle + width : length;
+            unsigned int left = start, right = middle, position = start;
+
+            while (left < middle && right < end) {
+                destination[position++] = compare(source[left], source[right]) <= 0 ? source[left++] : source[right++];
+            }
+            while (left < middle) destination[position++] = source[left++];
+            while (right < end) destination[position++] = source[right++];
+        }
+
+        ProcessElementList **swap = source;
+        source = destination;
+        destination = swap;
+    }
+
+    if (source != items) memcpy(items, source, length * sizeof(ProcessElementList *));
+}
+
+/*
+  * This function grows the arrays of a view to hold size processes.
+  * This function returns 1 if malloc failed.
+*/
+static char reserve_proc_view(ProcSortedView *view, unsigned int size) {
+    if (size <= view->size) return 0;
+
+    unsigned int new_size = view->size ? view->size : 64;
+    while (new_size < size) new_size *= 2;
+
+    ProcessElementList **processes = realloc(view->processes, new_size * sizeof(ProcessElementList *));
+    if (processes == NULL) return 1;
+    view->processes = processes;
+
+    ProcessElementList **buffer = realloc(view->buffer, new_size * sizeof(ProcessElementList *));
+    if (buffer == NULL) return 1;
+    view->buffer = buffer;
+
+    view->size = new_size;
+    view->buffer_size = new_size;
+    return 0;
+}
+
+/*
+  * This function initializes a sorted view of the list processes.
+  * The view is kept sorted by update_proc_view after each refresh_procs.
+  * This function returns 1 if malloc failed.
+*/
+char init_proc_view(ProcSortedView *view, StartProcList *list, ProcCompare compare) {
+    view->processes = NULL;
+    view->buffer = NULL;
+    view->length = 0;
+    view->size = 0;
+    view->buffer_size = 0;
+    view->compare = compare;
+
+    if (reserve_proc_view(view, list->length)) {
+        free_proc_view(view);
+        return 1;
+    }
+
+    for (ProcessElementList *element = list->first; element != NULL; element = element->next) {
+        view->processes[view->length++] = element;
+    }
+
+    sort_proc_array(view->processes, view->buffer, view->length, compare);
+    return 0;
+}
+
+/*
+  * This function sorts the view again after a refresh_procs (diff reports
+  * created and exited processes, NULL if only values changed) in
+  * O(n + k log k) for k misplaced processes: exited processes are dropped,
+  * misplaced and created processes are sorted apart and merged back.
+  * Exited processes must still be allocated (diff not released).
+  * This function returns 1 if malloc failed.
+*/
+char update_proc_view(ProcSortedView *view, ProcDiff *diff) {
+    unsigned int created = diff != NULL ? diff->created_length : 0;
+    if (reserve_proc_view(view, view->length + created)) return 1;
+
+    ProcessElementList **processes = view->processes, **buffer = view->buffer;
+    unsigned int length = 0, kept = 0, moved = 0;
+
+    for (unsigned int position = 0; position < view->length; position += 1) {
+        if (!(processes[position]->flags & PROC_FLAG_EXITED)) processes[length++] = processes[position];
+    }
+
+    for (unsigned int position = 0; position < length; position += 1) {
+        ProcessElementList *element = processes[position];
+        ProcessElementList *next = position + 1 < length ? processes[position + 1] : NULL;
+
+        char misplaced = kept && view->compare(processes[kept - 1], element) > 0;
+        if (!misplaced && next != NULL && view->compare(element, next) > 0) {     // element or next moved
+            misplaced = !kept || view->compare(processes[kept - 1], next) <= 0;
+        }
+
+        if (misplaced) buffer[moved++] = element;
+        else processes[kept++] = element;
+    }
+
+    for (unsigned int position = 0; position < created; position += 1) buffer[moved++] = diff->created[position];
+
+    if (moved > (kept + moved) / 4) {                // mostly unsorted: full sort is cheaper
+        memcpy(processes + kept, buffer, moved * sizeof(ProcessElementList *));
+        view->length = kept + moved;
+        sort_proc_array(processes, buffer, view->length, view->compare);
+        return 0;
+    }
+
+    sort_proc_array(buffer, processes + kept, moved, view->compare);   // free room after kept processes as temp
+
+    unsigned int left = kept, right = moved, position = kept + moved;
+    while (right) {                                  // merge from the end, kept processes first on ties
+        if (left && view->compare(processes[left - 1], buffer[right - 1]) > 0) {
+            processes[--position] = processes[--left];
+        } else {
+            processes[--position] = buffer[--right];
+        }
+    }
+
+    view->length = kept + moved;
+    return 0;
+}
+
+/*
+  * This function frees the arrays of a sorted view.
+*/
+void free_proc_view(ProcSortedView *view) {
+    free(view->processes);
+    free(view->buffer);
+    view->processes = NULL;
+    view->buffer = NULL;
+    view->length = 0;
+    view->size = 0;
+}
+
+/*
+  * This function initializes a top-K tracker keeping the k first processes
+  * in compare order (with compare_proc_cpu_usage: the k heaviest).
+  * This function returns 1 if malloc failed.
+*/
+char init_proc_top(ProcTopK *top, unsigned int k, ProcCompare compare) {
+    top->heap = malloc((k ? k : 1) * sizeof(ProcessElementList *));
+    top->length = 0;
+    top->k = k;
+    top->compare = compare;
+    return top->heap == NULL;
+}
+
+/*
+  * This function moves a heap entry up while it compares after its parent.
+*/
+static void sift_up_top(ProcTopK *top, unsigned int position) {
+    ProcessElementList *element = top->heap[position];
+
+    while (position > 0) {
+        unsigned int parent = (position - 1) / 2;
+        if (top->compare(top->heap[parent], element) >= 0) break;
+        top->heap[position] = top->heap[parent];
+        position = parent;
+    }
+
+    top->heap[position] = element;
+}
+
+/*
+  * This function moves a heap entry down while a child compares after it.
+*/
+static void sift_down_top(ProcTopK *top, unsigned int position) {
+    ProcessElementList *element = top->heap[position];
+
+    for (;;) {
+        unsigned int child = 2 * position + 1;
+        if (child >= top->length) break;
+        if (child + 1 < top->length && top->compare(top->heap[child + 1], top->heap[child]) > 0) child += 1;
+        if (top->compare(top->heap[child], element) <= 0) break;
+        top->heap[position] = top->heap[child];
+        position = child;
+    }
+
+    top->heap[position] = element;
+}
+
+/*
+  * This function offers a process to the tracker in O(log k), it is kept
+  * if there are less than k processes or if it compares before the root.
+  * A process must not be pushed twice (see update_proc_top).
+*/
+void push_proc_top(ProcTopK *top, ProcessElementList *element) {
+    if (top->length < top->k) {
+        top->heap[top->length] = element;
+        top->length += 1;
+        sift_up_top(top, top->length - 1);
+    } else if (top->k && top->compare(element, top->heap[0]) < 0) {
+        top->heap[0] = element;
+        sift_down_top(top, 0);
+    }
+}
+
+/*
+  * This function re-offers a process whose values changed in O(k).
+  * A kept process whose value decreased stays kept even if a not kept
+  * process is now heavier: call fill_proc_top to be exact.
+*/
+void update_proc_top(ProcTopK *top, ProcessElementList *element) {
+    for (unsigned int position = 0; position < top->length; position += 1) {
+        if (top->heap[position] == element) {
+            sift_up_top(top, position);
+            sift_down_top(top, position);
+            return;
+        }
+    }
+
+    push_proc_top(top, element);
+}
+
+/*
+  * This function removes a process from the tracker (exited process).
+*/
+void remove_proc_top(ProcTopK *top, ProcessElementList *element) {
+    for (unsigned int position = 0; position < top->length; position += 1) {
+        if (top->heap[position] == element) {
+            top->length -= 1;
+            if (position == top->length) return;
+            top->heap[position] = top->heap[top->length];
+            sift_up_top(top, position);
+            sift_down_top(top, position);
+            return;
+        }
+    }
+}
+
+/*
+  * This function refills the tracker from a list walk in O(n log k).
+*/
+void fill_proc_top(ProcTopK *top, StartProcList *list) {
+    top->length = 0;
+    for (ProcessElementList *element = list->first; element != NULL; element = element->next) push_proc_top(top, element);
+}
+
+/*
+  * This function writes the kept processes in compare order (heaviest
+  * first) in processes (k entries) and returns their count.
+*/
+unsigned int get_proc_top(ProcTopK *top, ProcessElementList **processes) {
+    unsigned int length = top->length;
+
+    for (unsigned int position = 0; position < length; position += 1) {
+        ProcessElementList *element = top->heap[position];
+        unsigned int slot = position;
+
+        while (slot > 0 && top->compare(processes[slot - 1], element) > 0) {
+            processes[slot] = processes[slot - 1];
+            slot -= 1;
+        }
+        processes[slot] = element;
+    }
+
+    return length;
+}
+
+/*
+  * This function frees the tracker heap.
+*/
+void free_proc_top(ProcTopK *top) {
+    free(top->heap);
+    top->heap = NULL;
+    top->length = 0;
+}
+
+/*
+  * This function initializes an iterator on the first process of the list.
+  * Iterators do not modify the list: many loops can run on the same list.
+  * Removing the process at the iterator position invalidates the iterator.
+*/
+void init_proc_iterator(StartProcList *list, ProcIterator *iterator) {
+    iterator->list = list;
+    iterator->position = list->first;
+    iterator->filter = NULL;
+    iterator->data = NULL;
+}
+
+/*
+  * This function sets the filter of an iterator (NULL: no filter),
+  * processes for which filter returns 0 are skipped.
+*/
+void set_proc_iterator_filter(ProcIterator *iterator, ProcFilter filter, void *data) {
+    iterator->filter = filter;
+    iterator->data = data;
+}
+
+/*
+  * This function returns the next process matching the iterator filter.
+  * This function returns NULL if there is no more process.
+*/
+ProcessElementList *get_next_iterator_proc(ProcIterator *iterator) {
+    ProcessElementList *process = iterator->position;
+
+    while (process != NULL && iterator->filter != NULL && !iterator->filter(process, iterator->data)) {
+        process = process->next;
+    }
+
+    iterator->position = process != NULL ? process->next : NULL;
+    return process;
+}
+
+/*
+  * This function returns the precedent process matching the iterator filter.
+  * This function returns NULL if there is no more process.
+*/
+ProcessElementList *get_precedent_iterator_proc(ProcIterator *iterator) {
+    ProcessElementList *process = iterator->position;
+
+    while (process != NULL && iterator->filter != NULL && !iterator->filter(process, iterator->data)) {
+        process = process->precedent;
+    }
+
+    iterator->position = process != NULL ? process->precedent : NULL;
+    return process;
+}
+
+/*
+  * This function places the iterator on a process by PID (O(1) with the PID index).
+  * This function returns 1 if PID is not found (the position is unchanged).
+*/
+char seek_iterator_pid(ProcIterator *iterator, unsigned int pid) {
+    ProcessElementList *process = get_proc_pid(iterator->list, pid);
+    if (process == NULL) return 1;
+
+    iterator->position = process;
+    return 0;
+}
+
+/*
+  * This function places the iterator on the first position.
+*/
+void goto_first_iterator_position(ProcIterator *iterator) {
+    iterator->position = iterator->list->first;
+}
+
+/*
+  * This function places the iterator on the last position.
+*/
+void goto_last_iterator_position(ProcIterator *iterator) {
+    iterator->position = iterator->list->last;
+}
+
+
+/*
+  * This function initializes an empty refresh difference.
+*/
+void init_proc_diff(ProcDiff *diff) {
+    diff->created = NULL;
+    diff->created_length = 0;
+    diff->created_size = 0;
+    diff->exited = NULL;
+    diff->exited_length = 0;
+    diff->exited_size = 0;
+}
+
+/*
+  * This function appends a process to a difference array.
+  * This function returns 1 if malloc failed.
+*/
+static char push_diff(ProcessElementList ***array, unsigned int *length, unsigned int *size, ProcessElementList *element) {
+    if (*length == *size) {
+        unsigned int new_size = *size ? *size * 2 : 64;
+        ProcessElementList **new_array = realloc(*array, new_size * sizeof(ProcessElementList *));
+        if (new_array == NULL) return 1;
+        *array = new_array;
+        *size = new_size;
+    }
+
+    (*array)[*length] = element;
+    *length += 1;
+    return 0;
+}
+
+/*
+  * This function frees the exited processes of a difference (they are
+  * not in the list anymore) and empties it, arrays are kept for reuse.
+*/
+static void release_proc_diff(StartProcList *list, ProcDiff *diff) {
+    for (unsigned int position = 0; position < diff->exited_length; position += 1) {
+        free_proc(list, diff->exited[position]);
+    }
+
+    diff->created_length = 0;
+    diff->exited_length = 0;
+}
+
+/*
+  * This function frees the exited processes and the arrays of a difference.
+*/
+void clean_proc_diff(StartProcList *list, ProcDiff *diff) {
+    release_proc_diff(list, diff);
+    free(diff->created);
+    free(diff->exited);
+    init_proc_diff(diff);
+}
+
+/*
+  * This function moves a process from the list to the exited processes.
+  * The process is freed immediately without difference to report to.
+*/
+static void exit_proc(StartProcList *list, ProcDiff *diff, ProcessElementList *element) {
+    unlink_proc(list, element);
+    element->flags |= PROC_FLAG_EXITED;
+
+    if (diff == NULL || push_diff(&diff->exited, &diff->exited_length, &diff->exited_size, element)) {
+        free_proc(list, element);
+    }
+}
+
+static char rescan_procs(StartProcList *list, ProcScanner *scanner, ProcDiff *diff);
+
+/*
+  * This function updates the list from a new /proc scan: known processes
+  * (same PID and start timestamp) are updated in place from their stat,
+  * new processes are appended and exited processes are unlinked.
+  * cpu_usage is computed from the previous scan (0 on the first one).
+  * Created processes (in the list) and exited processes (not in the list,
+  * valid until the next refresh or clean_proc_diff) are reported in diff
+  * (NULL: exited processes are freed). Executable, cmdline and user are
+  * only read for new processes. The PID index is enabled if needed.
+  * This function returns 1 if /proc cannot be read or malloc failed.
+*/
+char refresh_procs(StartProcList *list, ProcDiff *diff) {
+    ProcScanner *scanner = get_scanner(list);
+    if (scanner == NULL || enable_proc_strings(list) || enable_proc_pid_index(list)) return 1;
+    if (diff != NULL) release_proc_diff(list, diff);
+
+    return rescan_procs(list, scanner, diff);
+}
+
+/*
+  * This function is refresh_procs without emptying the difference first.
+  * This function returns 1 if /proc cannot be read or malloc failed.
+*/
+static char rescan_procs(StartProcList *list, ProcScanner *scanner, ProcDiff *diff) {
+    sample_total_time(scanner);
+    check_users(scanner, list->strings);
+    rewinddir(scanner->directory);
+    struct dirent *entry;
+    ProcStat stat;
+    char error = 0;
+
+    while ((entry = readdir(scanner->directory)) != NULL) {
+        if (entry->d_name[0] < '1' || entry->d_name[0] > '9') continue;
+        unsigned int pid = strtoul(entry->d_name, NULL, 10);
+        if (read_proc_stat(scanner, pid, &stat)) continue;
+
+        long double start_timestamp = get_start_timestamp(scanner, &stat);
+        ProcessElementList *element = get_proc_pid(list, pid);
+
+        if (element != NULL && element->start_timestamp == start_timestamp) {
+            element->ppid = stat.ppid;
+            element->tty = stat.tty_nr != 0;
+            element->flags |= PROC_FLAG_SEEN;
+            update_proc_usage(scanner, &stat, element);
+            continue;
+        }
+
+        if (element != NULL) exit_proc(list, diff, element);     // PID reused
+
+        element = new_proc(list);
+        if (element == NULL || read_proc(list, scanner, pid, &stat, element)) {
+            if (element == NULL) error = 1;
+            else free_proc(list, element);
+            continue;
+        }
+
+        element->flags |= PROC_FLAG_SEEN;
+        add_proc(list, element);
+        if (diff != NULL && push_diff(&diff->created, &diff->created_length, &diff->created_size, element)) error = 1;
+    }
+
+    ProcessElementList *element = list->first;
+    while (element != NULL) {
+        ProcessElementList *next = element->next;
+
+        if (element->flags & PROC_FLAG_SEEN) {
+            element->flags &= ~PROC_FLAG_SEEN;
+        } else {
+            exit_proc(list, diff, element);
+        }
+
+        element = next;
+    }
+
+    return error;
+}
+
+struct ProcEvents {
+    int socket;                      // netlink connector socket, non blocking
+    char dropped;                    // events have been lost, the next apply rescans /proc
+    char buffer[EVENTS_BUFFER_SIZE] __attribute__((aligned(NLMSG_ALIGNTO)));
+};
+
+/*
+  * This function sends a process connector subscription message.
+  * This function returns 1 if the message cannot be sent.
+*/
+static char send_events_operation(int socket, enum proc_cn_mcast_op operation) {
+    struct {
+        struct nlmsghdr header;
+        struct cn_msg message;
+        enum proc_cn_mcast_op operation;
+    } __attribute__((packed)) request;
+
+    memset(&request, 0, sizeof(request));
+    request.header.nlmsg_len = sizeof(request);
+    request.header.nlmsg_type = NLMSG_DONE;
+    request.header.nlmsg_pid = getpid();
+    request.message.id.idx = CN_IDX_PROC;
+    request.message.id.val = CN_VAL_PROC;
+    request.message.len = sizeof(enum proc_cn_mcast_op);
+    request.operation = operation;
+
+    return send(socket, &request, sizeof(request), 0) != sizeof(request);
+}
+
+/*
+  * This function subscribes to the kernel process connector (fork, exec
+  * and exit events), it requires CAP_NET_ADMIN.
+  * This function returns NULL if the connector is not available or malloc failed.
+*/
+ProcEvents *open_proc_events(void) {
+    ProcEvents *events = malloc(sizeof(ProcEvents));
+    if (events == NULL) return NULL;
+
+    events->dropped = 0;
+    events->socket = socket(PF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_CONNECTOR);
+    if (events->socket < 0) {
+        free(events);
+        return NULL;
+    }
+
+    struct sockaddr_nl address;
+    memset(&address, 0, sizeof(address));
+    address.nl_family = AF_NETLINK;
+    address.nl_groups = CN_IDX_PROC;
+
+    if (bind(events->socket, (struct sockaddr *)&address, sizeof(address)) || send_events_operation(events->socket, PROC_CN_MCAST_LISTEN)) {
+        close(events->socket);
+        free(events);
+        return NULL;
+    }
+
+    return events;
+}
+
+/*
+  * This function unsubscribes and frees the event source.
+*/
+void close_proc_events(ProcEvents *events) {
+    send_events_operation(events->socket, PROC_CN_MCAST_IGNORE);
+    close(events->socket);
+    free(events);
+}
+
+/*
+  * This function returns the event source descriptor, readable when
+  * apply_proc_events has events to apply (for poll, select or epoll).
+*/
+int get_proc_events_fd(ProcEvents *events) {
+    return events->socket;
+}
+
+/*
+  * This function adds a forked process that has already exited from its
+  * event with the parent strings (inherited by fork). Its start_timestamp
+  * stays 0 (unknown): the event clock is monotonic and cannot be compared
+  * with the /proc start times used as process identity.
+  * This function returns 1 if malloc failed.
+*/
+static char add_exited_fork(StartProcList *list, ProcDiff *diff, struct proc_event *event) {
+    ProcessElementList *element = get_proc_pid(list, event->event_data.fork.child_pid);
+    if (element != NULL) exit_proc(list, diff, element);       // PID reused
+
+    element = new_proc(list);
+    if (element == NULL) return 1;
+
+    element->pid = event->event_data.fork.child_pid;
+    element->ppid = event->event_data.fork.parent_tgid;
+
+    ProcessElementList *parent = get_proc_pid(list, element->ppid);
+    if (parent != NULL && set_proc_strings(list, element, parent->executable, parent->cmdline, parent->user)) {
+        free_proc(list, element);
+        return 1;
+    }
+
+    add_proc(list, element);
+    return diff != NULL && push_diff(&diff->created, &diff->created_length, &diff->created_size, element);
+}
+
+/*
+  * This function returns 1 if a process read failed because it has exited
+  * (or its PID has been reused) rather than because malloc failed.
+*/
+static char has_event_proc_exited(ProcScanner *scanner, ProcessElementList *element) {
+    ProcStat stat;
+    return read_proc_stat(scanner, element->pid, &stat) || get_start_timestamp(scanner, &stat) != element->start_timestamp;
+}
+
+/*
+  * This function reads a new or exec'd process and adds it to the list
+  * (a stale process with the same PID is reported as exited). On exec
+  * only the strings are read again, usage counters keep their interval.
+  * A process that exits while it is read is handled as exited.
+  * This function returns 1 if malloc failed.
+*/
+static char read_event_proc(StartProcList *list, ProcScanner *scanner, ProcDiff *diff, unsigned int pid, struct proc_event *event) {
+    ProcStat stat;
+    if (read_proc_stat(scanner, pid, &stat)) {                  // already exited, the exit event follows
+        return event->what == PROC_EVENT_FORK && add_exited_fork(list, diff, event);
+    }
+
+    ProcessElementList *element = get_proc_pid(list, pid);
+    if (element != NULL && element->start_timestamp == get_start_timestamp(scanner, &stat)) {
+        if (set_proc_strings(list, element, NULL, NULL, NULL)) return 1;      // exec: strings are read again
+        element->flags |= (PROC_FIELD_ALL & ~scanner->fields) << PROC_FLAG_PENDING_SHIFT;
+        if (scanner->fields == 0 || read_proc_fields(list, scanner, pid, &stat, element, scanner->fields) == 0) return 0;
+        if (!has_event_proc_exited(scanner, element)) return 1;
+
+        exit_proc(list, diff, element);
+        return 0;
+    }
+
+    if (element != NULL) exit_proc(list, diff, element);       // PID reused
+
+    element = new_proc(list);
+    if (element == NULL) return 1;
+
+    if (read_proc(list, scanner, pid, &stat, element)) {
+        char error = !has_event_proc_exited(scanner, element);
+        free_proc(list, element);
+        return error;
+    }
+
+    add_proc(list, element);
+    return diff != NULL && push_diff(&diff->created, &diff->created_length, &diff->created_size, element);
+}
+
+/*
+  * This function applies a process connector event to the list.
+  * This function returns 1 if malloc failed.
+*/
+static char apply_proc_event(StartProcList *list, ProcScanner *scanner, ProcDiff *diff, struct proc_event *event) {
+    switch (event->what) {
+        case PROC_EVENT_FORK:
+            if (event->event_data.fork.child_pid != event->event_data.fork.child_tgid) return 0;     // new thread
+            return read_event_proc(list, scanner, diff, event->event_data.fork.child_pid, event);
+        case PROC_EVENT_EXEC:
+            return read_event_proc(list, scanner, diff, event->event_data.exec.process_pid, event);
+        case PROC_EVENT_EXIT: {
+            if (event->event_data.exit.process_pid != event->event_data.exit.process_tgid) return 0;
+            ProcessElementList *element = get_proc_pid(list, event->event_data.exit.process_pid);
+            if (element != NULL) exit_proc(list, diff, element);
+            return 0;
+        }
+        default:
+            return 0;
+    }
+}
+
+/*
+  * This function applies the pending events (without blocking) to the list:
+  * forked and exec'd processes are read and added or updated, exited
+  * processes are unlinked, like refresh_procs they are reported in diff
+  * (a short-lived process can be both created and exited). CPU and memory
+  * usages are still updated by refresh_procs. When the kernel dropped
+  * events, /proc is scanned again to resynchronize the list.
+  * This function returns 1 if /proc cannot be read or malloc failed.
+*/
+char apply_proc_events(StartProcList *list, ProcEvents *events, ProcDiff *diff) {
+    ProcScanner *scanner = get_scanner(list);
+    if (scanner == NULL || enable_proc_strings(list) || enable_proc_pid_index(list)) return 1;
+    if (diff != NULL) release_proc_diff(list, diff);
+
+    char error = 0;
+    for (;;) {
+        int length = recv(events->socket, events->buffer, EVENTS_BUFFER_SIZE, 0);         // signed, NLMSG_NEXT decrements it
+        if (length < 0) {
+            if (errno == ENOBUFS) {
+                events->dropped = 1;
+                continue;
+            }
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        for (struct nlmsghdr *header = (struct nlmsghdr *)events->buffer; NLMSG_OK(header, length); header = NLMSG_NEXT(header, length)) {
+            if (header->nlmsg_type == NLMSG_ERROR || header->nlmsg_type == NLMSG_OVERRUN) {
+                events->dropped = 1;
+                continue;
+            }
+
+            struct cn_msg *message = NLMSG_DATA(header);
+            if (events->dropped || message->id.idx != CN_IDX_PROC || message->id.val != CN_VAL_PROC) continue;
+            struct proc_event event;     // message data is only 4 bytes aligned
+            memcpy(&event, message->data, message->len < sizeof(event) ? message->len : sizeof(event));
+            if (apply_proc_event(list, scanner, diff, &event)) error = 1;
+        }
+    }
+
+    if (events->dropped) {
+        events->dropped = 0;
+        if (rescan_procs(list, scanner, diff)) error = 1;
+    }
+
+    return error;
+}
+
+typedef struct StringOffset {
+    const char *value;               // NULL: empty slot
+    unsigned int offset;
+} StringOffset;
+
+typedef struct SnapshotStrings {
+    char *blob;
+    unsigned int length;
+    unsigned int size;
+    StringOffset *offsets;           // pointer -> offset, deduplicates interned strings
+    unsigned int offsets_size;       // power of two
+} SnapshotStrings;
+
+/*
+  * This function returns the offset of a string in the snapshot blob,
+  * adding it the first time its pointer is seen.
+  * This function returns (unsigned int)-1 if malloc failed.
+*/
+static unsigned int add_snapshot_string(SnapshotStrings *strings, const char *value) {
+    if (value == NULL || *value == 0) return 0;
+
+    size_t pointer = (size_t)value;
+    unsigned int mask = strings->offsets_size - 1;
+    unsigned int slot = (unsigned int)((pointer >> 4) * 2654435761u) & mask;
+
+    while (strings->offsets[slot].value != NULL) {
+        if (strings->offsets[slot].value == value) return strings->offsets[slot].offset;
+        slot = (slot + 1) & mask;
+    }
+
+    size_t length = strlen(value) + 1;
+    while (strings->length + length > strings->size) {
+        char *blob = realloc(strings->blob, strings->size * 2);
+        if (blob == NULL) return (unsigned int)-1;
+        strings->blob = blob;
+        strings->size *= 2;
+    }
+
+    memcpy(strings->blob + strings->length, value, length);
+    strings->offsets[slot].value = value;
+    strings->offsets[slot].offset = strings->length;
+    strings->length += length;
+    return strings->offsets[slot].offset;
+}
+
+/*
+  * This function packs the list in a struct-of-arrays snapshot: each field is
+  * a contiguous column and strings are offsets in one blob. The snapshot
+  * does not reference the list and must be freed with free_proc_snapshot.
+  * This function returns 1 if malloc failed.
+*/
+char export_proc_snapshot(StartProcList *list, ProcSnapshot *snapshot) {
+    unsigned int length = list->length;
+    size_t count = length ? length : 1;
+    char *columns = malloc(count * (sizeof(double) + 7 * sizeof(unsigned int) + 1));
+
+    SnapshotStrings strings;
+    strings.size = 4096;
+    strings.length = 1;
+    strings.blob = malloc(strings.size);
+    strings.offsets_size = 64;
+    while (strings.offsets_size < count * 4) strings.offsets_size *= 2;
+    strings.offsets = calloc(strings.offsets_size, sizeof(StringOffset));
+
+    if (columns == NULL || strings.blob == NULL || strings.offsets == NULL) {
+        free(columns);
+        free(strings.blob);
+        free(strings.offsets);
+        return 1;
+    }
+
+    strings.blob[0] = 0;
+    snapshot->length = length;
+    snapshot->start = (double *)columns;
+    snapshot->pid = (unsigned int *)(snapshot->start + count);
+    snapshot->ppid = snapshot->pid + count;
+    snapshot->cpu = (float *)(snapshot->ppid + count);
+    snapshot->memory = snapshot->cpu + count;
+    snapshot->executable = (unsigned int *)(snapshot->memory + count);
+    snapshot->cmdline = snapshot->executable + count;
+    snapshot->user = snapshot->cmdline + count;
+    snapshot->tty = (char *)(snapshot->user + count);
+
+    unsigned int position = 0;
+    char error = 0;
+
+    for (ProcessElementList *element = list->first; element != NULL; element = element->next) {
+        snapshot->start[position] = element->start_timestamp;
+        snapshot->pid[position] = element->pid;
+        snapshot->ppid[position] = element->ppid;
+        snapshot->cpu[position] = element->cpu_usage;
+        snapshot->memory[position] = element->memory_usage;
+        snapshot->tty[position] = element->tty;
+        snapshot->executable[position] = add_snapshot_string(&strings, element->executable);
+        snapshot->cmdline[position] = add_snapshot_string(&strings, element->cmdline);
+        snapshot->user[position] = add_snapshot_string(&strings, element->user);
+
+        if (snapshot->executable[position] == (unsigned int)-1 || snapshot->cmdline[position] == (unsigned int)-1 || snapshot->user[position] == (unsigned int)-1) error = 1;
+        position += 1;
+    }
+
+    free(strings.offsets);
+    snapshot->strings = strings.blob;
+    snapshot->strings_size = strings.length;
+
+    if (error) {
+        free_proc_snapshot(snapshot);
+        return 1;
+    }
+
+    return 0;
+}
+
+/*
+  * This function frees the columns and strings of a snapshot.
+*/
+void free_proc_snapshot(ProcSnapshot *snapshot) {
+    free(snapshot->start);
+    free(snapshot->strings);
+    snapshot->start = NULL;
+    snapshot->strings = NULL;
+    snapshot->length = 0;
+}
+
+/*
+  * This function returns the sum of a snapshot column (cpu or memory).
+  * Independent partial sums let the compiler vectorize the loop, they are
+  * double like the scalar sum (float lanes lose precision on large lists).
+*/
+double sum_snapshot_values(const float *values, unsigned int length) {
+    double sums[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+    unsigned int position = 0;
+
+    for (; position + 8 <= length; position += 8) {
+        for (unsigned int lane = 0; lane < 8; lane += 1) sums[lane] += values[position + lane];
+    }
+
+    double sum = 0;
+    for (; position < length; position += 1) sum += values[position];
+    for (unsigned int lane = 0; lane < 8; lane += 1) sum += sums[lane];
+    return sum;
+}
+
+/*
+  * This function writes in indexes (length entries) the positions of the
+  * values greater than threshold and returns their count (branchless).
+*/
+unsigned int filter_snapshot_values(const float *values, unsigned int length, float threshold, unsigned int *indexes) {
+    unsigned int count = 0;
+
+    for (unsigned int position = 0; position < length; position += 1) {
+        indexes[count] = position;
+        count += values[position] > threshold;
+    }
+
+    return count;
+}
+
+/*
+  * This function writes in indexes (k entries) the positions of the k
+  * greatest values, greatest first, and returns their count.
+  * Values smaller than the current k-th are rejected with one comparison.
+*/
+unsigned int top_snapshot_values(const float *values, unsigned int length, unsigned int k, unsigned int *indexes) {
+    unsigned int count = 0;
+
+    for (unsigned int position = 0; position < length && k; position += 1) {
+        float value = values[position];
+        if (count == k && value <= values[indexes[k - 1]]) continue;
+
+        unsigned int slot = count < k ? count++ : k - 1;
+        while (slot > 0 && values[indexes[slot - 1]] < value) {
+            indexes[slot] = indexes[slot - 1];
+            slot -= 1;
+        }
+        indexes[slot] = position;
+    }
+
+    return count;
+}
+
+/*
+  * This function returns the slot of a PID in the tree hash table
+  * (empty slot if the PID is not in the tree).
+*/
+static ProcTreeSlot *find_tree_slot(ProcTree *tree, unsigned int pid) {
+    unsigned int mask = tree->slots_size - 1;
+    unsigned int slot = (pid * 2654435761u) & mask;
+
+    while (tree->slots[slot].position && tree->slots[slot].pid != pid) slot = (slot + 1) & mask;
+    return &tree->slots[slot];
+}
+
+/*
+  * This function returns the preorder position of a PID, (unsigned int)-1 if not found.
+*/
+static unsigned int get_tree_position(ProcTree *tree, unsigned int pid) {
+    if (tree->slots == NULL) return (unsigned int)-1;
+    return find_tree_slot(tree, pid)->position - 1;
+}
+
+/*
+  * This function builds the process tree of the list from ppid in linear
+  * time: processes are ordered depth-first so each subtree is a contiguous
+  * range, with prefix sums for O(1) subtree CPU and memory aggregation.
+  * Processes whose parent is not in the list (or cycles) are roots.
+  * The tree references list processes, rebuild it after list changes.
+  * This function returns 1 if malloc failed.
+*/
+char build_proc_tree(StartProcList *list, ProcTree *tree) {
+    unsigned int length = list->length;
+    unsigned int none = (unsigned int)-1;
+    size_t count = length ? length : 1;
+
+    memset(tree, 0, sizeof(ProcTree));
+    tree->slots_size = 64;
+    while (tree->slots_size < count * 2) tree->slots_size *= 2;
+
+    ProcessElementList **nodes = malloc(count * sizeof(ProcessElementList *));
+    unsigned int *links = malloc(count * 3 * sizeof(unsigned int));     // parent, first child, next sibling by list index
+    tree->order = malloc(count * sizeof(ProcessElementList *));
+    tree->subtree_length = malloc(count * sizeof(unsigned int));
+    tree->parent = malloc(count * sizeof(unsigned int));
+    tree->cpu_sums = malloc((count + 1) * sizeof(double));
+    tree->memory_sums = malloc((count + 1) * sizeof(double));
+    tree->slots = calloc(tree->slots_size, sizeof(ProcTreeSlot));
+
+    if (nodes == NULL || links == NULL || tree->order == NULL || tree->subtree_length == NULL || tree->parent == NULL || tree->cpu_sums == NULL || tree->memory_sums == NULL || tree->slots == NULL) {
+        free(nodes);
+        free(links);
+        free_proc_tree(tree);
+        return 1;
+    }
+
+    unsigned int *parents = links, *first_child = links + count, *next_sibling = links + 2 * count;
+    unsigned int index = 0;
+
+    for (ProcessElementList *element = list->first; element != NULL; element = element->next) {
+        nodes[index] = element;
+        ProcTreeSlot *slot = find_tree_slot(tree, element->pid);
+        if (!slot->position) {                  // duplicated PID: the first one is the parent
+            slot->pid = element->pid;
+            slot->position = index + 1;
+        }
+        first_child[index] = none;
+        index += 1;
+    }
+
+    for (index = length; index-- > 0;) {        // reverse order: children are linked in list order
+        ProcessElementList *element = nodes[index];
+        unsigned int parent = element->ppid != element->pid ? find_tree_slot(tree, element->ppid)->position - 1 : none;
+        if (parent == index) parent = none;
+
+        parents[index] = parent;
+        if (parent != none) {
+            next_sibling[index] = first_child[parent];
+            first_child[parent] = index;
+        }
+    }
+
+    unsigned int *stack = tree->subtree_length;     // reused as DFS stack before sizes are computed
+    unsigned int *visited = tree->parent;           // list index -> position + 1, 0: not visited
+    memset(visited, 0, count * sizeof(unsigned int));
+    unsigned int position = 0;
+
+    for (unsigned int pass = 0; pass < 2; pass += 1) {     // roots first, then processes in parent cycles
+        for (unsigned int root = 0; root < length; root += 1) {
+            if (visited[root] || (pass == 0 && parents[root] != none)) continue;
+
+            unsigned int stack_length = 0;
+            stack[stack_length++] = root;
+            visited[root] = 1;
+
+            while (stack_length) {
+                unsigned int current = stack[--stack_length];
+                visited[current] = position + 1;
+                tree->order[position++] = nodes[current];
+
+                unsigned int children = stack_length;
+                for (unsigned int child = first_child[current]; child != none; child = next_sibling[child]) {
+                    if (visited[child]) continue;
+                    visited[child] = 1;
+                    stack[stack_length++] = child;
+                }
+
+                for (unsigned int left = children, right = stack_length; left + 1 < right; left += 1, right -= 1) {
+                    unsigned int swap = stack[left];     // first child on top of the stack
+                    stack[left] = stack[right - 1];
+                    stack[right - 1] = swap;
+                }
+            }
+        }
+    }
+
+    for (index = 0; index < length; index += 1) {   // list index -> position
+        first_child[index] = visited[index] - 1;
+    }
+
+    for (index = 0; index < length; index += 1) {
+        unsigned int current = first_child[index];
+        unsigned int parent = parents[index];
+        parent = (parent != none) ? first_child[parent] : none;
+        tree->parent[current] = (parent != none && parent < current) ? parent : none;   // cycle entry is a root
+    }
+
+    memset(tree->slots, 0, tree->slots_size * sizeof(ProcTreeSlot));
+    tree->cpu_sums[0] = 0;
+    tree->memory_sums[0] = 0;
+
+    for (position = 0; position < length; position += 1) {
+        ProcessElementList *element = tree->order[position];
+        ProcTreeSlot *slot = find_tree_slot(tree, element->pid);
+        if (!slot->position) {
+            slot->pid = element->pid;
+            slot->position = position + 1;
+        }
+
+        tree->subtree_length[position] = 1;
+        tree->cpu_sums[position + 1] = tree->cpu_sums[position] + element->cpu_usage;
+        tree->memory_sums[position + 1] = tree->memory_sums[position] + element->memory_usage;
+    }
+
+    for (position = length; position-- > 0;) {
+        if (tree->parent[position] != none) tree->subtree_length[tree->parent[position]] += tree->subtree_length[position];
+    }
+
+    tree->length = length;
+    free(nodes);
+    free(links);
+    return 0;
+}
+
+/*
+  * This function frees the arrays of a process tree.
+*/
+void free_proc_tree(ProcTree *tree) {
+    free(tree->order);
+    free(tree->subtree_length);
+    free(tree->parent);
+    free(tree->cpu_sums);
+    free(tree->memory_sums);
+    free(tree->slots);
+    memset(tree, 0, sizeof(ProcTree));
+}
+
+/*
+  * This function sets processes to the contiguous array of a process and
+  * all its descendants (the process first) and returns its length.
+  * This function returns 0 if PID is not found.
+*/
+unsigned int get_proc_subtree(ProcTree *tree, unsigned int pid, ProcessElementList ***processes) {
+    unsigned int position = get_tree_position(tree, pid);
+    if (position == (unsigned int)-1) return 0;
+
+    *processes = tree->order + position;
+    return tree->subtree_length[position];
+}
+
+/*
+  * This function writes up to size direct children of a process and
+  * returns the number of children (may be greater than size).
+*/
+unsigned int get_proc_children(ProcTree *tree, unsigned int pid, ProcessElementList **children, unsigned int size) {
+    unsigned int position = get_tree_position(tree, pid);
+    if (position == (unsigned int)-1) return 0;
+
+    unsigned int count = 0;
+    unsigned int end = position + tree->subtree_length[position];
+
+    for (unsigned int child = position + 1; child < end; child += tree->subtree_length[child]) {
+        if (count < size) children[count] = tree->order[child];
+        count += 1;
+    }
+
+    return count;
+}
+
+/*
+  * This function returns the parent of a process in the tree.
+  * This function returns NULL if PID is not found or is a root.
+*/
+ProcessElementList *get_proc_tree_parent(ProcTree *tree, unsigned int pid) {
+    unsigned int position = get_tree_position(tree, pid);
+    if (position == (unsigned int)-1 || tree->parent[position] == (unsigned int)-1) return NULL;
+    return tree->order[tree->parent[position]];
+}
+
+/*
+  * This function returns the CPU usage of a process and all its descendants.
+*/
+double get_proc_subtree_cpu(ProcTree *tree, unsigned int pid) {
+    unsigned int position = get_tree_position(tree, pid);
+    if (position == (unsigned int)-1) return 0;
+    return tree->cpu_sums[position + tree->subtree_length[position]] - tree->cpu_sums[position];
+}
+
+/*
+  * This function returns the memory usage of a process and all its descendants.
+*/
+double get_proc_subtree_memory(ProcTree *tree, unsigned int pid) {
+    unsigned int position = get_tree_position(tree, pid);
+    if (position == (unsigned int)-1) return 0;
+    return tree->memory_sums[position + tree->subtree_length[position]] - tree->memory_sums[position];
+}
+
+_Static_assert(sizeof(ProcFileHeader) == 64, "snapshot file header must be 64 bytes");
+_Static_assert(sizeof(ProcRecord) == 48, "snapshot file records must be 48 bytes");
+
+/*
+  * This function writes all bytes of a buffer in a file.
+  * This function returns 1 on write error.
+*/
+static char write_all(int file, const void *buffer, size_t size) {
+    const char *position = buffer;
+
+    while (size) {
+        ssize_t written = write(file, position, size);
+        if (written <= 0) return 1;
+        position += written;
+        size -= written;
+    }
+
+    return 0;
+}
+
+/*
+  * This function writes the list in a binary snapshot file: a header,
+  * fixed width records and a deduplicated string table. The file is
+  * written in "<path>.tmp" and renamed, readers never see a partial file.
+  * This function returns 1 if malloc or a file operation failed.
+*/
+char write_proc_snapshot_file(StartProcList *list, const char *path) {
+    ProcSnapshot snapshot;
+    if (export_proc_snapshot(list, &snapshot)) return 1;
+
+    size_t path_length = strlen(path);
+    char *temporary = malloc(path_length + 5);
+    ProcRecord *records = calloc(snapshot.length ? snapshot.length : 1, sizeof(ProcRecord));
+
+    if (temporary == NULL || records == NULL) {
+        free(temporary);
+        free(records);
+        free_proc_snapshot(&snapshot);
+        return 1;
+    }
+
+    for (unsigned int position = 0; position < snapshot.length; position += 1) {
+        records[position].start_timestamp = snapshot.start[position];
+        records[position].pid = snapshot.pid[position];
+        records[position].ppid = snapshot.ppid[position];
+        records[position].cpu_usage = snapshot.cpu[position];
+        records[position].memory_usage = snapshot.memory[position];
+        records[position].executable = snapshot.executable[position];
+        records[position].cmdline = snapshot.cmdline[position];
+        records[position].user = snapshot.user[position];
+        records[position].tty = snapshot.tty[position];
+    }
+
+    ProcFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, PROC_FILE_MAGIC, sizeof(header.magic));
+    header.version = PROC_FILE_VERSION;
+    header.record_size = sizeof(ProcRecord);
+    header.length = snapshot.length;
+    header.strings_size = snapshot.strings_size;
+    header.records_offset = sizeof(ProcFileHeader);
+    header.strings_offset = header.records_offset + (uint64_t)snapshot.length * sizeof(ProcRecord);
+    header.timestamp = time(NULL);
+
+    memcpy(temporary, path, path_length);
+    memcpy(temporary + path_length, ".tmp", 5);
+    int file = open(temporary, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    char error = file < 0;
+
+    if (!error) {
+        error = write_all(file, &header, sizeof(header)) || write_all(file, records, snapshot.length * sizeof(ProcRecord)) || write_all(file, snapshot.strings, snapshot.strings_size);
+        error |= close(file) != 0;
+        error = error || rename(temporary, path) != 0;
+        if (error) unlink(temporary);
+    }
+
+    free(temporary);
+    free(records);
+    free_proc_snapshot(&snapshot);
+    return error;
+}
+
+/*
+  * This function maps a binary snapshot file, records are read in place
+  * without parsing or allocation. Only the header is validated.
+  * This function returns 1 if the file cannot be mapped or is not valid.
+*/
+char open_proc_snapshot_file(ProcSnapshotFile *file, const char *path) {
+    memset(file, 0, sizeof(ProcSnapshotFile));
+    int descriptor = open(path, O_RDONLY | O_CLOEXEC);
+    if (descriptor < 0) return 1;
+
+    struct stat status;
+    if (fstat(descriptor, &status) || (size_t)status.st_size < sizeof(ProcFileHeader)) {
+        close(descriptor);
+        return 1;
+    }
+
+    void *map = mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+    close(descriptor);
+    if (map == MAP_FAILED) return 1;
+
+    const ProcFileHeader *header = map;
+    size_t size = status.st_size;
+    char valid = memcmp(header->magic, PROC_FILE_MAGIC, sizeof(header->magic)) == 0 && header->version == PROC_FILE_VERSION && header->record_size == sizeof(ProcRecord);
+    valid = valid && header->records_offset <= size && header->length <= (size - header->records_offset) / sizeof(ProcRecord) && header->records_offset % 8 == 0;
+    valid = valid && header->strings_offset <= size && header->strings_size && header->strings_size <= size - header->strings_offset;
+    valid = valid && header->records_offset + (uint64_t)header->length * sizeof(ProcRecord) <= header->strings_offset;
+    valid = valid && ((const char *)map)[header->strings_offset + header->strings_size - 1] == 0;
+
+    if (!valid) {
+        munmap(map, size);
+        return 1;
+    }
+
+    file->map = map;
+    file->size = size;
+    file->header = header;
+    file->records = (const ProcRecord *)((const char *)map + header->records_offset);
+    file->strings = (const char *)map + header->strings_offset;
+    file->length = header->length;
+    return 0;
+}
+
+/*
+  * This function returns a record of a mapped snapshot file.
+  * This function returns NULL if index is greater or equal than file length.
+*/
+const ProcRecord *get_proc_record(ProcSnapshotFile *file, unsigned int index) {
+    if (index >= file->length) return NULL;
+    return file->records + index;
+}
+
+/*
+  * This function returns a string of a mapped snapshot file from a record offset,
+  * an offset out of the string table returns the empty string.
+*/
+const char *get_proc_record_string(ProcSnapshotFile *file, uint32_t offset) {
+    if (offset >= file->header->strings_size) return file->strings;   // strings start with the empty string
+    return file->strings + offset;
+}
+
+/*
+  * This function unmaps a snapshot file.
+*/
+void close_proc_snapshot_file(ProcSnapshotFile *file) {
+    if (file->map != NULL) munmap(file->map, file->size);
+    memset(file, 0, sizeof(ProcSnapshotFile));
+}
+
+typedef struct HistoryChange {
+    unsigned int pid;
+    unsigned int ppid;
+    float cpu_usage;
+    float memory_usage;
+    char tty;
+} HistoryChange;
+
+typedef struct HistoryDelta {
+    ProcessElementList *created;     // copies (links unused), strings referenced in the history table
+    unsigned int created_length;
+    unsigned int *exited;            // PIDs
+    unsigned int exited_length;
+    HistoryChange *changed;
+    unsigned int changed_length;
+} HistoryDelta;
+
+struct ProcHistory {
+    ProcStrings *strings;            // shared by keyframe, current and deltas
+    StartProcList *keyframe;         // state at keyframe_tick
+    StartProcList *current;          // state at the last tick, used to compute deltas
+    unsigned long long keyframe_tick;
+    unsigned long long ticks;        // recorded ticks
+
+    HistoryDelta *deltas;            // ring: delta i goes from tick keyframe_tick + i to the next one
+    unsigned int capacity;
+    unsigned int start;
+    unsigned int length;
+};
+
+/*
+  * This function creates a list for the history, sharing its string table.
+  * This function returns NULL if malloc failed.
+*/
+static StartProcList *create_history_list(ProcHistory *history) {
+    StartProcList *list = malloc(sizeof(StartProcList));
+    if (list == NULL) return NULL;
+
+    if (init_proc_list_with_pool(list, 0) || enable_proc_pid_index(list)) {
+        clean_proc_list(list);
+        return NULL;
+    }
+
+    list->strings = history->strings;
+    return list;
+}
+
+/*
+  * This function frees a history list without its shared string table.
+*/
+static void destroy_history_list(StartProcList *list) {
+    if (list == NULL) return;
+    list->strings = NULL;
+    clean_proc_list(list);
+}
+
+/*
+  * This function copies the values of a process (not links or strings).
+*/
+static void copy_proc_values(ProcessElementList *destination, const ProcessElementList *source) {
+    destination->pid = source->pid;
+    destination->ppid = source->ppid;
+    destination->tty = source->tty;
+    destination->cpu_usage = source->cpu_usage;
+    destination->memory_usage = source->memory_usage;
+    destination->cpu_time = source->cpu_time;
+    destination->start_timestamp = source->start_timestamp;
+}
+
+/*
+  * This function appends a copy of a process (strings interned) to a list.
+  * This function returns 1 if malloc failed.
+*/
+static char add_proc_copy(StartProcList *list, const ProcessElementList *source) {
+    ProcessElementList *element = new_proc(list);
+    if (element == NULL) return 1;
+
+    copy_proc_values(element, source);
+    if (set_proc_strings(list, element, source->executable, source->cmdline, source->user)) {
+        free_proc(list, element);
+        return 1;
+    }
+
+    add_proc(list, element);
+    return 0;
+}
+
+/*
+  * This function frees the arrays and string references of a delta.
+*/
+static void free_history_delta(ProcHistory *history, HistoryDelta *delta) {
+    for (unsigned int position = 0; position < delta->created_length; position += 1) {
+        release_string(history->strings, delta->created[position].executable);
+        release_string(history->strings, delta->created[position].cmdline);
+        release_string(history->strings, delta->created[position].user);
+    }
+
+    free(delta->created);
+    free(delta->exited);
+    free(delta->changed);
+    memset(delta, 0, sizeof(HistoryDelta));
+}
+
+/*
+  * This function allocates the processes created by a delta for a list
+  * (strings interned, not linked yet) so the delta can be committed without failure.
+  * This function returns 1 if malloc failed (nothing is allocated).
+*/
+static char prepare_history_delta(StartProcList *list, HistoryDelta *delta, ProcessElementList ***created) {
+    *created = malloc((delta->created_length + 1) * sizeof(ProcessElementList *));
+    if (*created == NULL) return 1;
+
+    for (unsigned int position = 0; position < delta->created_length; position += 1) {
+        ProcessElementList *source = &delta->created[position];
+        ProcessElementList *element = new_proc(list);
+
+        if (element == NULL || set_proc_strings(list, element, source->executable, source->cmdline, source->user)) {
+            if (element != NULL) free_proc(list, element);
+            while (position) free_proc(list, (*created)[--position]);
+            free(*created);
+            *created = NULL;
+            return 1;
+        }
+
+        copy_proc_values(element, source);
+        (*created)[position] = element;
+    }
+
+    return 0;
+}
+
+/*
+  * This function frees the processes allocated by prepare_history_delta.
+*/
+static void discard_history_delta(StartProcList *list, HistoryDelta *delta, ProcessElementList **created) {
+    for (unsigned int position = 0; position < delta->created_length; position += 1) free_proc(list, created[position]);
+    free(created);
+}
+
+/*
+  * This function applies a prepared delta to a list: exited processes are
+  * removed, created processes are linked and changes are applied.
+*/
+static void commit_history_delta(StartProcList *list, HistoryDelta *delta, ProcessElementList **created) {
+    for (unsigned int position = 0; position < delta->exited_length; position += 1) {
+        ProcessElementList *element = get_proc_pid(list, delta->exited[position]);
+        if (element != NULL) remove_proc(list, element);
+    }
+
+    for (unsigned int position = 0; position < delta->created_length; position += 1) add_proc(list, created[position]);
+    free(created);
+
+    for (unsigned int position = 0; position < delta->changed_length; position += 1) {
+        HistoryChange *change = &delta->changed[position];
+        ProcessElementList *element = get_proc_pid(list, change->pid);
+        if (element == NULL) continue;
+
+        element->ppid = change->ppid;
+        element->tty = change->tty;
+        element->cpu_usage = change->cpu_usage;
+        element->memory_usage = change->memory_usage;
+    }
+}
+
+/*
+  * This function applies a delta to a list.
+  * This function returns 1 if malloc failed (the list is unchanged).
+*/
+static char apply_history_delta(StartProcList *list, HistoryDelta *delta) {
+    ProcessElementList **created;
+    if (prepare_history_delta(list, delta, &created)) return 1;
+
+    commit_history_delta(list, delta, created);
+    return 0;
+}
+
+/*
+  * This function creates a history keeping a keyframe and up to capacity
+  * per-tick deltas (created, exited and changed processes). Memory scales
+  * with churn: only two full lists are kept (keyframe and last tick).
+  * This function returns NULL if malloc failed.
+*/
+ProcHistory *create_proc_history(unsigned int capacity) {
+    ProcHistory *history = calloc(1, sizeof(ProcHistory));
+    if (history == NULL) return NULL;
+
+    history->capacity = capacity ? capacity : 1;
+    history->deltas = calloc(history->capacity, sizeof(HistoryDelta));
+    history->strings = create_strings();
+
+    if (history->deltas == NULL || history->strings == NULL || (history->keyframe = create_history_list(history)) == NULL || (history->current = create_history_list(history)) == NULL) {
+        destroy_proc_history(history);
+        return NULL;
+    }
+
+    return history;
+}
+
+/*
+  * This function frees the history, its lists, deltas and strings.
+*/
+void destroy_proc_history(ProcHistory *history) {
+    if (history->deltas != NULL && history->strings != NULL) {
+        for (unsigned int position = 0; position < history->length; position += 1) {
+            free_history_delta(history, &history->deltas[(history->start + position) % history->capacity]);
+        }
+    }
+
+    destroy_history_list(history->keyframe);
+    destroy_history_list(history->current);
+    if (history->strings != NULL) destroy_strings(history->strings);
+    free(history->deltas);
+    free(history);
+}
+
+/*
+  * This function appends an entry to a delta array (grown by doubling).
+  * This function returns 1 if malloc failed.
+*/
+static char grow_history_array(void **array, unsigned int length, size_t item_size) {
+    if (length & (length - 1)) return 0;     // sizes are powers of two
+
+    void *new_array = realloc(*array, (length ? length * 2 : 16) * item_size);
+    if (new_array == NULL) return 1;
+    *array = new_array;
+    return 0;
+}
+
+/*
+  * This function computes the delta between the last tick and the list,
+  * the current state is not updated (its flags are only used while computing).
+  * This function returns 1 if malloc failed.
+*/
+static char compute_history_delta(ProcHistory *history, StartProcList *list, HistoryDelta *delta) {
+    StartProcList *current = history->current;
+    char error = 0;
+
+    for (ProcessElementList *element = list->first; element != NULL && !error; element = element->next) {
+        ProcessElementList *known = get_proc_pid(current, element->pid);
+
+        if (known != NULL && known->start_timestamp == element->start_timestamp) {
+            if (known->ppid != element->ppid || known->tty != element->tty || known->cpu_usage != element->cpu_usage || known->memory_usage != element->memory_usage) {
+                if (grow_history_array((void **)&delta->changed, delta->changed_length, sizeof(HistoryChange))) {
+                    error = 1;
+                    break;
+                }
+
+                HistoryChange *change = &delta->changed[delta->changed_length++];
+                change->pid = element->pid;
+                change->ppid = element->ppid;
+                change->tty = element->tty;
+                change->cpu_usage = element->cpu_usage;
+                change->memory_usage = element->memory_usage;
+            }
+
+            known->flags |= PROC_FLAG_SEEN;
+            continue;
+        }
+
+        // new process, a reused PID is not seen so the known process is reported as exited
+        if (grow_history_array((void **)&delta->created, delta->created_length, sizeof(ProcessElementList))) {
+            error = 1;
+            break;
+        }
+
+        ProcessElementList *created = &delta->created[delta->created_length];
+        memset(created, 0, sizeof(ProcessElementList));
+        copy_proc_values(created, element);
+        char **fields[3] = {&created->executable, &created->cmdline, &created->user};
+        char *values[3] = {element->executable, element->cmdline, element->user};
+
+        for (unsigned int field = 0; field < 3; field += 1) {
+            if (values[field] == NULL) continue;
+            *fields[field] = intern_string(history->strings, values[field], strlen(values[field]));
+
+            if (*fields[field] == NULL) {
+                while (field) release_string(history->strings, *fields[--field]);
+                error = 1;
+                break;
+            }
+        }
+
+        if (!error) delta->created_length += 1;
+    }
+
+    for (ProcessElementList *element = current->first; element != NULL; element = element->next) {
+        if (element->flags & PROC_FLAG_SEEN) {
+            element->flags &= ~PROC_FLAG_SEEN;
+        } else if (!error) {
+            if (grow_history_array((void **)&delta->exited, delta->exited_length, sizeof(unsigned int))) {
+                error = 1;
+            } else {
+                delta->exited[delta->exited_length++] = element->pid;
+            }
+        }
+    }
+
+    return error;
+}
+
+/*
+  * This function records the list state as the next tick. The first tick
+  * is the keyframe, next ticks are deltas; when the ring is full the
+  * oldest delta is applied to the keyframe and discarded. Allocations are
+  * done before the history is updated.
+  * This function returns 1 if malloc failed (the history is unchanged).
+*/
+char record_proc_history(ProcHistory *history, StartProcList *list) {
+    if (history->ticks == 0) {
+        for (ProcessElementList *element = list->first; element != NULL; element = element->next) {
+            if (add_proc_copy(history->keyframe, element) || add_proc_copy(history->current, element)) {
+                while (history->keyframe->last != NULL) free_proc(history->keyframe, pop_proc(history->keyframe));
+                while (history->current->last != NULL) free_proc(history->current, pop_proc(history->current));
+                return 1;
+            }
+        }
+
+        history->ticks = 1;
+        return 0;
+    }
+
+    HistoryDelta delta;
+    memset(&delta, 0, sizeof(HistoryDelta));
+    HistoryDelta *oldest = history->length == history->capacity ? &history->deltas[history->start] : NULL;
+    ProcessElementList **current_created = NULL, **keyframe_created = NULL;
+
+    if (compute_history_delta(history, list, &delta) || prepare_history_delta(history->current, &delta, &current_created) || (oldest != NULL && prepare_history_delta(history->keyframe, oldest, &keyframe_created))) {
+        if (current_created != NULL) discard_history_delta(history->current, &delta, current_created);
+        free_history_delta(history, &delta);
+        return 1;
+    }
+
+    if (oldest != NULL) {
+        commit_history_delta(history->keyframe, oldest, keyframe_created);
+        free_history_delta(history, oldest);
+        history->start = (history->start + 1) % history->capacity;
+        history->length -= 1;
+        history->keyframe_tick += 1;
+    }
+
+    commit_history_delta(history->current, &delta, current_created);
+    history->deltas[(history->start + history->length) % history->capacity] = delta;
+    history->length += 1;
+    history->ticks += 1;
+    return 0;
+}
+
+/*
+  * This function sets the first and last ticks that can be restored.
+  * This function returns 1 if nothing has been recorded.
+*/
+char get_proc_history_ticks(ProcHistory *history, unsigned long long *first, unsigned long long *last) {
+    if (history->ticks == 0) return 1;
+
+    *first = history->keyframe_tick;
+    *last = history->keyframe_tick + history->length;
+    return 0;
+}
+
+/*
+  * This function appends to an initialized list the processes at a past
+  * tick: keyframe copy with the deltas applied up to this tick.
+  * This function returns 1 if the tick is not in the history or malloc failed.
+*/
+char restore_proc_history(ProcHistory *history, unsigned long long tick, StartProcList *list) {
+    if (history->ticks == 0 || tick < history->keyframe_tick || tick > history->keyframe_tick + history->length) return 1;
+    if (enable_proc_pid_index(list)) return 1;
+
+    for (ProcessElementList *element = history->keyframe->first; element != NULL; element = element->next) {
+        if (add_proc_copy(list, element)) return 1;
+    }
+
+    for (unsigned long long position = 0; position < tick - history->keyframe_tick; position += 1) {
+        if (apply_history_delta(list, &history->deltas[(history->start + position) % history->capacity])) return 1;
+    }
+
+    return 0;
+}
+
+typedef struct PublishedSnapshot {
+    ProcSnapshot snapshot;
+    unsigned long long version;
+    struct PublishedSnapshot *retired;   // next retired snapshot, waiting for readers
+} PublishedSnapshot;
+
+struct ProcPublisher {
+    _Atomic(PublishedSnapshot *) current;
+    _Atomic(PublishedSnapshot *) hazards[PROC_MAX_READERS];    // snapshot in use by each reader
+    atomic_uchar used[PROC_MAX_READERS];
+    PublishedSnapshot *retired;          // writer only
+    unsigned long long version;          // writer only
+};
+
+/*
+  * This function creates a publisher: one writer publishes immutable
+  * snapshots of its list, readers acquire them without locks. Readers
+  * never block the writer: replaced snapshots are freed when no reader
+  * slot references them anymore (hazard pointers).
+  * This function returns NULL if malloc failed.
+*/
+ProcPublisher *create_proc_publisher(void) {
+    ProcPublisher *publisher = malloc(sizeof(ProcPublisher));
+    if (publisher == NULL) return NULL;
+
+    atomic_init(&publisher->current, NULL);
+    for (unsigned int slot = 0; slot < PROC_MAX_READERS; slot += 1) {
+        atomic_init(&publisher->hazards[slot], NULL);
+        atomic_init(&publisher->used[slot], 0);
+    }
+
+    publisher->retired = NULL;
+    publisher->version = 0;
+    return publisher;
+}
+
+/*
+  * This function frees a published snapshot.
+*/
+static void free_published_snapshot(PublishedSnapshot *published) {
+    free_proc_snapshot(&published->snapshot);
+    free(published);
+}
+
+/*
+  * This function frees the retired snapshots no reader references.
+*/
+static void reclaim_published_snapshots(ProcPublisher *publisher) {
+    PublishedSnapshot **link = &publisher->retired;
+
+    while (*link != NULL) {
+        PublishedSnapshot *published = *link;
+        char used = 0;
+
+        for (unsigned int slot = 0; slot < PROC_MAX_READERS && !used; slot += 1) {
+            used = atomic_load(&publisher->hazards[slot]) == published;
+        }
+
+        if (used) {
+            link = &published->retired;
+        } else {
+            *link = published->retired;
+            free_published_snapshot(published);
+        }
+    }
+}
+
+/*
+  * This function frees the publisher and its snapshots, readers must be unregistered.
+*/
+void destroy_proc_publisher(ProcPublisher *publisher) {
+    PublishedSnapshot *published = atomic_load(&publisher->current);
+    if (published != NULL) free_published_snapshot(published);
+
+    while (publisher->retired != NULL) {
+        published = publisher->retired;
+        publisher->retired = published->retired;
+        free_published_snapshot(published);
+    }
+
+    free(publisher);
+}
+
+/*
+  * This function publishes a snapshot of the list for the readers (only
+  * one thread may publish). The list can be modified again immediately.
+  * This function returns 1 if malloc failed.
+*/
+char publish_proc_list(ProcPublisher *publisher, StartProcList *list) {
+    PublishedSnapshot *published = malloc(sizeof(PublishedSnapshot));
+    if (published == NULL) return 1;
+
+    if (export_proc_snapshot(list, &published->snapshot)) {
+        free(published);
+        return 1;
+    }
+
+    published->version = ++publisher->version;
+    PublishedSnapshot *old = atomic_exchange(&publisher->current, published);
+
+    if (old != NULL) {
+        old->retired = publisher->retired;
+        publisher->retired = old;
+    }
+
+    reclaim_published_snapshots(publisher);
+    return 0;
+}
+
+/*
+  * This function registers a reader on a free slot.
+  * This function returns 1 if PROC_MAX_READERS readers are registered.
+*/
+char register_proc_reader(ProcPublisher *publisher, ProcReader *reader) {
+    for (unsigned int slot = 0; slot < PROC_MAX_READERS; slot += 1) {
+        unsigned char expected = 0;
+
+        if (atomic_compare_exchange_strong(&publisher->used[slot], &expected, 1)) {
+            reader->publisher = publisher;
+            reader->slot = slot;
+            reader->snapshot = NULL;
+            reader->version = 0;
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/*
+  * This function releases the reader snapshot and frees its slot.
+*/
+void unregister_proc_reader(ProcReader *reader) {
+    release_proc_snapshot(reader);
+    atomic_store(&reader->publisher->used[reader->slot], 0);
+}
+
+/*
+  * This function returns the last published snapshot, valid and immutable
+  * until release_proc_snapshot (or the next acquire) by this reader.
+  * This function returns NULL if nothing has been published.
+*/
+ProcSnapshot *acquire_proc_snapshot(ProcReader *reader) {
+    ProcPublisher *publisher = reader->publisher;
+    PublishedSnapshot *published;
+
+    do {
+        published = atomic_load(&publisher->current);
+        atomic_store(&publisher->hazards[reader->slot], published);
+    } while (published != atomic_load(&publisher->current));
+
+    if (published == NULL) {
+        reader->snapshot = NULL;
+        reader->version = 0;
+        return NULL;
+    }
+
+    reader->snapshot = &published->snapshot;
+    reader->version = published->version;
+    return reader->snapshot;
+}
+
+/*
+  * This function releases the snapshot acquired by the reader.
+*/
+void release_proc_snapshot(ProcReader *reader) {
+    atomic_store(&reader->publisher->hazards[reader->slot], NULL);
+    reader->snapshot = NULL;
+}
+
+enum QueryType {QUERY_AND, QUERY_OR, QUERY_NOT, QUERY_NUMBER, QUERY_EQUAL, QUERY_CONTAINS};
+enum QueryField {FIELD_PID, FIELD_PPID, FIELD_CPU_USAGE, FIELD_MEMORY_USAGE, FIELD_TTY, FIELD_START_TIMESTAMP, FIELD_CPU_TIME, FIELD_EXECUTABLE, FIELD_CMDLINE, FIELD_USER};
+enum QueryOperator {OPERATOR_EQUAL, OPERATOR_DIFFERENT, OPERATOR_LESS, OPERATOR_LESS_EQUAL, OPERATOR_GREATER, OPERATOR_GREATER_EQUAL, OPERATOR_CONTAINS};
+
+static const char *query_fields[] = {"pid", "ppid", "cpu_usage", "memory_usage", "tty", "start_timestamp", "cpu_time", "executable", "cmdline", "user"};
+
+typedef struct ParseNode {
+    unsigned char type;
+    unsigned char field;
+    unsigned char operator;
+    char negated;                    // string != is a negated equality
+    unsigned int cost;               // estimated evaluation cost, cheap tests first
+    double number;
+    char *string;
+    size_t length;
+    struct ParseNode **children;
+    unsigned int children_length;
+} ParseNode;
+
+typedef struct QueryNode {
+    unsigned char type;
+    unsigned char field;
+    unsigned char operator;
+    char negated;
+    unsigned int size;               // nodes in this subtree (this node included), children follow it
+    unsigned int children_length;
+    double number;
+    const char *string;
+    size_t length;
+    size_t *shift;                   // Horspool bad character shifts for contains
+} QueryNode;
+
+struct ProcQuery {
+    QueryNode *nodes;                // pre-order plan, the root first
+    unsigned int length;
+    char *strings;                   // values of string tests, NUL terminated
+    size_t *shifts;                  // 256 shifts by contains test
+};
+
+typedef struct QueryParser {
+    const char *cursor;
+    unsigned int depth;              // nested ! and ( being parsed
+} QueryParser;
+
+/*
+  * This function frees a parse tree.
+*/
+static void free_parse_node(ParseNode *node) {
+    if (node == NULL) return;
+
+    for (unsigned int child = 0; child < node->children_length; child += 1) free_parse_node(node->children[child]);
+    free(node->children);
+    free(node->string);
+    free(node);
+}
+
+/*
+  * This function skips spaces and returns 1 if the next characters are the token.
+*/
+static char accept_query_token(QueryParser *parser, const char *token) {
+    while (*parser->cursor == ' ' || *parser->cursor == '\t' || *parser->cursor == '\n') parser->cursor += 1;
+
+    size_t length = strlen(token);
+    if (strncmp(parser->cursor, token, length)) return 0;
+    parser->cursor += length;
+    return 1;
+}
+
+/*
+  * This function adds a child to an AND or OR parse node,
+  * children of the same operator are merged (a && (b && c) is a && b && c).
+  * This function returns 1 if malloc failed.
+*/
+static char add_parse_child(ParseNode *node, ParseNode *child) {
+    if (child->type == node->type) {
+        for (unsigned int position = 0; position < child->children_length; position += 1) {
+            if (add_parse_child(node, child->children[position])) return 1;
+            child->children[position] = NULL;
+        }
+
+        child->children_length = 0;
+        free_parse_node(child);
+        return 0;
+    }
+
+    ParseNode **children = realloc(node->children, (node->children_length + 1) * sizeof(ParseNode *));
+    if (children == NULL) return 1;
+
+    node->children = children;
+    node->children[node->children_length++] = child;
+    node->cost += child->cost;
+    return 0;
+}
+
+static ParseNode *parse_query_or(QueryParser *parser);
+
+/*
+  * This function parses a comparison: field operator value.
+  * This function returns NULL on syntax error or if malloc failed.
+*/
+static ParseNode *parse_query_comparison(QueryParser *parser) {
+    while (*parser->cursor == ' ' || *parser->cursor == '\t' || *parser->cursor == '\n') parser->cursor += 1;
+
+    size_t length = 0;
+    while ((parser->cursor[length] >= 'a' && parser->cursor[length] <= 'z') || parser->cursor[length] == '_') length += 1;
+
+    unsigned int field = 0;
+    while (field < sizeof(query_fields) / sizeof(query_fields[0]) && (strlen(query_fields[field]) != length || strncmp(query_fields[field], parser->cursor, length))) field += 1;
+    if (field == sizeof(query_fields) / sizeof(query_fields[0])) return NULL;
+    parser->cursor += length;
+
+    static const char *operators[] = {"==", "!=", "<=", ">=", "<", ">", "contains"};
+    static const unsigned char operator_values[] = {OPERATOR_EQUAL, OPERATOR_DIFFERENT, OPERATOR_LESS_EQUAL, OPERATOR_GREATER_EQUAL, OPERATOR_LESS, OPERATOR_GREATER, OPERATOR_CONTAINS};
+    unsigned int operator = 0;
+    while (operator < 7 && !accept_query_token(parser, operators[operator])) operator += 1;
+    if (operator == 7) return NULL;
+
+    ParseNode *node = calloc(1, sizeof(ParseNode));
+    if (node == NULL) return NULL;
+    node->field = field;
+    node->operator = operator_values[operator];
+
+    if (field < FIELD_EXECUTABLE) {
+        char *end;
+        while (*parser->cursor == ' ' || *parser->cursor == '\t' || *parser->cursor == '\n') parser->cursor += 1;
+        node->number = strtod(parser->cursor, &end);
+
+        if (end == parser->cursor || node->operator == OPERATOR_CONTAINS) {
+            free(node);
+            return NULL;
+        }
+
+        parser->cursor = end;
+        node->type = QUERY_NUMBER;
+        node->cost = 1;
+        return node;
+    }
+
+    if ((node->operator != OPERATOR_EQUAL && node->operator != OPERATOR_DIFFERENT && node->operator != OPERATOR_CONTAINS) || !accept_query_token(parser, "\"")) {
+        free(node);
+        return NULL;
+    }
+
+    node->string = malloc(strlen(parser->cursor) + 1);
+    if (node->string == NULL) {
+        free(node);
+        return NULL;
+    }
+
+    while (*parser->cursor != '"') {
+        if (*parser->cursor == '\\' && parser->cursor[1] != 0) parser->cursor += 1;
+        if (*parser->cursor == 0) {
+            free_parse_node(node);
+            return NULL;
+        }
+        node->string[node->length++] = *parser->cursor++;
+    }
+
+    parser->cursor += 1;
+    node->string[node->length] = 0;
+    node->type = node->operator == OPERATOR_CONTAINS ? QUERY_CONTAINS : QUERY_EQUAL;
+    node->negated = node->operator == OPERATOR_DIFFERENT;
+    node->cost = node->type == QUERY_CONTAINS ? 8 : 4;
+    return node;
+}
+
+/*
+  * This function parses a negation, a parenthesized expression or a comparison.
+  * This function returns NULL on syntax error (QUERY_MAXIMUM_DEPTH nested
+  * negations or parentheses included) or if malloc failed.
+*/
+static ParseNode *parse_query_unary(QueryParser *parser) {
+    if (accept_query_token(parser, "!") ) {
+        if (parser->depth == QUERY_MAXIMUM_DEPTH) return NULL;
+
+        parser->depth += 1;
+        ParseNode *child = parse_query_unary(parser);
+        parser->depth -= 1;
+        if (child == NULL) return NULL;
+
+        ParseNode *node = calloc(1, sizeof(ParseNode));
+        if (node == NULL || (node->children = malloc(sizeof(ParseNode *))) == NULL) {
+            free(node);
+            free_parse_node(child);
+            return NULL;
+        }
+
+        node->type = QUERY_NOT;
+        node->children[0] = child;
+        node->children_length = 1;
+        node->cost = child->cost;
+        return node;
+    }
+
+    if (accept_query_token(parser, "(")) {
+        if (parser->depth == QUERY_MAXIMUM_DEPTH) return NULL;
+
+        parser->depth += 1;
+        ParseNode *node = parse_query_or(parser);
+        parser->depth -= 1;
+        if (node != NULL && !accept_query_token(parser, ")")) {
+            free_parse_node(node);
+            return NULL;
+        }
+        return node;
+    }
+
+    return parse_query_comparison(parser);
+}
+
+/*
+  * This function parses operands separated by an operator (&& or ||).
+  * This function returns NULL on syntax error or if malloc failed.
+*/
+static ParseNode *parse_query_list(QueryParser *parser, unsigned char type) {
+    ParseNode *first = type == QUERY_AND ? parse_query_unary(parser) : parse_query_list(parser, QUERY_AND);
+    if (first == NULL) return NULL;
+
+    const char *token = type == QUERY_AND ? "&&" : "||";
+    if (!accept_query_token(parser, token)) return first;
+
+    ParseNode *node = calloc(1, sizeof(ParseNode));
+    if (node == NULL || add_parse_child(node, first)) {
+        free(node);
+        free_parse_node(first);
+        return NULL;
+    }
+    node->type = type;
+
+    do {
+        ParseNode *child = type == QUERY_AND ? parse_query_unary(parser) : parse_query_list(parser, QUERY_AND);
+        if (child == NULL || add_parse_child(node, child)) {
+            free_parse_node(child);
+            free_parse_node(node);
+            return NULL;
+        }
+    } while (accept_query_token(parser, token));
+
+    return node;
+}
+
+/*
+  * This function parses operands separated by ||.
+*/
+static ParseNode *parse_query_or(QueryParser *parser) {
+    return parse_query_list(parser, QUERY_OR);
+}
+
+/*
+  * This function sorts the children of AND and OR nodes by cost (stable),
+  * predicates have no side effect so cheap tests can short-circuit first.
+*/
+static void order_parse_node(ParseNode *node) {
+    for (unsigned int child = 0; child < node->children_length; child += 1) order_parse_node(node->children[child]);
+
+    for (unsigned int position = 1; position < node->children_length; position += 1) {
+        ParseNode *child = node->children[position];
+        unsigned int insert = position;
+
+        while (insert > 0 && node->children[insert - 1]->cost > child->cost) {
+            node->children[insert] = node->children[insert - 1];
+            insert -= 1;
+        }
+
+        node->children[insert] = child;
+    }
+}
+
+/*
+  * This function counts nodes, string bytes and contains tests of a parse tree.
+*/
+static void measure_parse_node(ParseNode *node, unsigned int *nodes, size_t *strings, unsigned int *shifts) {
+    *nodes += 1;
+    if (node->string != NULL) *strings += node->length + 1;
+    if (node->type == QUERY_CONTAINS) *shifts += 1;
+
+    for (unsigned int child = 0; child < node->children_length; child += 1) measure_parse_node(node->children[child], nodes, strings, shifts);
+}
+
+/*
+  * This function writes a parse tree in pre-order in the query plan.
+*/
+static void emit_parse_node(ProcQuery *query, ParseNode *node, size_t *strings, unsigned int *shifts) {
+    QueryNode *plan = &query->nodes[query->length++];
+    plan->type = node->type;
+    plan->field = node->field;
+    plan->operator = node->operator;
+    plan->negated = node->negated;
+    plan->number = node->number;
+    plan->children_length = node->children_length;
+    plan->length = node->length;
+
+    if (node->string != NULL) {
+        memcpy(query->strings + *strings, node->string, node->length + 1);
+        plan->string = query->strings + *strings;
+        *strings += node->length + 1;
+    }
+
+    if (node->type == QUERY_CONTAINS) {
+        plan->shift = query->shifts + (size_t)*shifts * 256;
+        *shifts += 1;
+
+        for (unsigned int character = 0; character < 256; character += 1) plan->shift[character] = node->length ? node->length : 1;
+        for (size_t position = 0; position + 1 < node->length; position += 1) plan->shift[(unsigned char)node->string[position]] = node->length - 1 - position;
+    }
+
+    unsigned int start = query->length - 1;
+    for (unsigned int child = 0; child < node->children_length; child += 1) emit_parse_node(query, node->children[child], strings, shifts);
+    query->nodes[start].size = query->length - start;
+}
+
+/*
+  * This function compiles a filter expression into a query plan, for example:
+  * user == "postgres" && cpu_usage > 5 && cmdline contains "--replica"
+  * Numeric fields (pid, ppid, cpu_usage, memory_usage, tty, start_timestamp,
+  * cpu_time) support == != < <= > >=, string fields (executable, cmdline,
+  * user) support == != and contains; tests are combined with &&, ||, !
+  * and parentheses (up to 256 nested). Numeric tests are evaluated before
+  * string tests.
+  * This function returns NULL on syntax error or if malloc failed.
+*/
+ProcQuery *compile_proc_query(const char *expression) {
+    QueryParser parser = {expression, 0};
+    ParseNode *root = parse_query_or(&parser);
+    if (root == NULL) return NULL;
+
+    if (accept_query_token(&parser, "") && *parser.cursor != 0) {
+        free_parse_node(root);
+        return NULL;
+    }
+
+    order_parse_node(root);
+    unsigned int nodes = 0, shifts = 0;
+    size_t strings = 0;
+    measure_parse_node(root, &nodes, &strings, &shifts);
+
+    ProcQuery *query = calloc(1, sizeof(ProcQuery));
+    if (query == NULL || (query->nodes = calloc(nodes, sizeof(QueryNode))) == NULL || (query->strings = malloc(strings + 1)) == NULL || (query->shifts = malloc((shifts ? shifts : 1) * 256 * sizeof(size_t))) == NULL) {
+        if (query != NULL) free_proc_query(query);
+        free_parse_node(root);
+        return NULL;
+    }
+
+    strings = 0;
+    shifts = 0;
+    emit_parse_node(query, root, &strings, &shifts);
+    free_parse_node(root);
+    return query;
+}
+
+/*
+  * This function frees a compiled query.
+*/
+void free_proc_query(ProcQuery *query) {
+    free(query->nodes);
+    free(query->strings);
+    free(query->shifts);
+    free(query);
+}
+
+/*
+  * This function returns 1 if the pattern is in the text (Boyer-Moore-Horspool).
+*/
+static char contains_query_string(const char *text, const QueryNode *node) {
+    size_t length = strlen(text);
+    if (node->length > length) return 0;
+
+    const char *last = node->string + node->length - 1;
+    for (size_t position = 0; position <= length - node->length; position += node->shift[(unsigned char)text[position + node->length - 1]]) {
+        if (text[position + node->length - 1] == *last && memcmp(text + position, node->string, node->length - 1) == 0) return 1;
+    }
+
+    return 0;
+}
+
+/*
+  * This function evaluates a plan node for a process.
+*/
+static char evaluate_query(const QueryNode *node, const ProcessElementList *element) {
+    switch (node->type) {
+        case QUERY_AND:
+        case QUERY_OR: {
+            const QueryNode *child = node + 1;
+            char stop = node->type == QUERY_OR;
+
+            for (unsigned int position = 0; position < node->children_length; position += 1) {
+                if (evaluate_query(child, element) == stop) return stop;
+                child += child->size;
+            }
+
+            return !stop;
+        }
+        case QUERY_NOT:
+            return !evaluate_query(node + 1, element);
+        case QUERY_NUMBER: {
+            double value;
+
+            switch (node->field) {
+                case FIELD_PID: value = element->pid; break;
+                case FIELD_PPID: value = element->ppid; break;
+                case FIELD_CPU_USAGE: value = element->cpu_usage; break;
+                case FIELD_MEMORY_USAGE: value = element->memory_usage; break;
+                case FIELD_TTY: value = element->tty; break;
+                case FIELD_START_TIMESTAMP: value = element->start_timestamp; break;
+                default: value = element->cpu_time; break;
+            }
+
+            switch (node->operator) {
+                case OPERATOR_EQUAL: return value == node->number;
+                case OPERATOR_DIFFERENT: return value != node->number;
+                case OPERATOR_LESS: return value < node->number;
+                case OPERATOR_LESS_EQUAL: return value <= node->number;
+                case OPERATOR_GREATER: return value > node->number;
+                default: return value >= node->number;
+            }
+        }
+        default: {
+            const char *text = node->field == FIELD_EXECUTABLE ? element->executable : node->field == FIELD_CMDLINE ? element->cmdline : element->user;
+            if (text == NULL) text = "";
+
+            if (node->type == QUERY_CONTAINS) return node->length == 0 || contains_query_string(text, node);
+            return (strcmp(text, node->string) == 0) != node->negated;
+        }
+    }
+}
+
+/*
+  * This function returns 1 if a process matches the query, it is a ProcFilter
+  * (data is the ProcQuery) usable with set_proc_iterator_filter.
+  * Pending strings (scan field mask) are compared as empty strings.
+*/
+char match_proc_query(ProcessElementList *element, void *query) {
+    return evaluate_query(((ProcQuery *)query)->nodes, element);
+}
+
+/*
+  * This function writes up to size matching processes of the list (not
+  * copied) and returns the number of matches (may be greater than size).
+*/
+unsigned int select_proc_query(StartProcList *list, ProcQuery *query, ProcessElementList **matches, unsigned int size) {
+    unsigned int count = 0;
+
+    for (ProcessElementList *element = list->first; element != NULL; element = element->next) {
+        if (!evaluate_query(query->nodes, element)) continue;
+        if (count < size) matches[count] = element;
+        count += 1;
+    }
+
+    return count;
+}
+
+typedef struct CompactString {
+    unsigned int references;
+    unsigned int hash;
+    char value[];
+} CompactString;
+
+struct ProcCompactStrings {
+    char *blob;                      // entries aligned on 4 bytes, node offsets point to their values
+    unsigned int length;             // used bytes
+    unsigned int size;
+    unsigned int released;           // bytes of released entries, reclaimed by pack_compact_strings
+    unsigned int *slots;             // value offsets by hash, 0: empty slot
+    unsigned int slots_size;         // power of two, at least twice count
+    unsigned int count;
+};
+
+/*
+  * This function returns the entry of a string offset.
+*/
+static CompactString *get_compact_entry(ProcCompactStrings *strings, unsigned int offset) {
+    return (CompactString *)(strings->blob + offset - offsetof(CompactString, value));
+}
+
+/*
+  * This function returns the bytes used by an entry in the blob.
+*/
+static unsigned int get_compact_entry_size(CompactString *entry) {
+    return (offsetof(CompactString, value) + strlen(entry->value) + 4) & ~3u;
+}
+
+/*
+  * This function creates an empty compact string table.
+  * This function returns NULL if malloc failed.
+*/
+static ProcCompactStrings *create_compact_strings(void) {
+    ProcCompactStrings *strings = malloc(sizeof(ProcCompactStrings));
+    if (strings == NULL) return NULL;
+
+    strings->size = 4096;
+    strings->blob = malloc(strings->size);
+    strings->slots_size = STRINGS_MINIMUM_SIZE;
+    strings->slots = calloc(strings->slots_size, sizeof(unsigned int));
+
+    if (strings->blob == NULL || strings->slots == NULL) {
+        free(strings->blob);
+        free(strings->slots);
+        free(strings);
+        return NULL;
+    }
+
+    strings->length = 0;
+    strings->released = 0;
+    strings->count = 0;
+    return strings;
+}
+
+/*
+  * This function frees a compact string table.
+*/
+static void destroy_compact_strings(ProcCompactStrings *strings) {
+    free(strings->blob);
+    free(strings->slots);
+    free(strings);
+}
+
+/*
+  * This function adds a string offset in the hash slots (no resize).
+*/
+static void put_compact_slot(ProcCompactStrings *strings, unsigned int offset) {
+    unsigned int mask = strings->slots_size - 1;
+    unsigned int slot = get_compact_entry(strings, offset)->hash & mask;
+
+    while (strings->slots[slot] != 0) slot = (slot + 1) & mask;
+    strings->slots[slot] = offset;
+}
+
+/*
+  * This function doubles the hash slots of a compact string table.
+  * This function returns 1 if malloc failed.
+*/
+static char grow_compact_slots(ProcCompactStrings *strings) {
+    unsigned int *old_slots = strings->slots;
+    unsigned int old_size = strings->slots_size;
+
+    strings->slots = calloc(old_size * 2, sizeof(unsigned int));
+    if (strings->slots == NULL) {
+        strings->slots = old_slots;
+        return 1;
+    }
+
+    strings->slots_size = old_size * 2;
+    for (unsigned int slot = 0; slot < old_size; slot += 1) {
+        if (old_slots[slot] != 0) put_compact_slot(strings, old_slots[slot]);
+    }
+
+    free(old_slots);
+    return 0;
+}
+
+/*
+  * This function returns the offset of the shared copy of a string and takes
+  * a reference on it. The blob may move: value must not point into it.
+  * This function returns 0 if malloc failed or offsets would overflow.
+*/
+static unsigned int intern_compact_string(ProcCompactStrings *strings, const char *value) {
+    size_t length = strlen(value);
+    unsigned int hash = hash_string(value, length);
+    unsigned int mask = strings->slots_size - 1;
+
+    for (unsigned int slot = hash & mask; strings->slots[slot] != 0; slot = (slot + 1) & mask) {
+        CompactString *entry = get_compact_entry(strings, strings->slots[slot]);
+        if (entry->hash == hash && strcmp(entry->value, value) == 0) {
+            entry->references += 1;
+            return strings->slots[slot];
+        }
+    }
+
+    if ((strings->count + 1) * 2 > strings->slots_size && grow_compact_slots(strings)) return 0;
+
+    size_t size = (offsetof(CompactString, value) + length + 4) & ~(size_t)3;
+    if (size > 0xffffffffu - strings->length) return 0;
+
+    if (strings->length + size > strings->size) {
+        size_t blob_size = strings->size;
+        while (blob_size < strings->length + size) blob_size *= 2;
+        if (blob_size > 0xffffffffu) blob_size = 0xffffffffu;
+
+        char *blob = realloc(strings->blob, blob_size);
+        if (blob == NULL) return 0;
+        strings->blob = blob;
+        strings->size = blob_size;
+    }
+
+    CompactString *entry = (CompactString *)(strings->blob + strings->length);
+    entry->references = 1;
+    entry->hash = hash;
+    memcpy(entry->value, value, length + 1);
+
+    unsigned int offset = strings->length + offsetof(CompactString, value);
+    strings->length += size;
+    strings->count += 1;
+    put_compact_slot(strings, offset);
+    return offset;
+}
+
+/*
+  * This function drops a reference on a string offset, the last one removes
+  * the string (its bytes are reclaimed by pack_compact_strings).
+  * Linear probing without tombstones: following slots are shifted back.
+*/
+static void release_compact_string(ProcCompactStrings *strings, unsigned int offset) {
+    if (offset == 0) return;
+
+    CompactString *entry = get_compact_entry(strings, offset);
+    entry->references -= 1;
+    if (entry->references) return;
+
+    unsigned int mask = strings->slots_size - 1;
+    unsigned int slot = entry->hash & mask;
+    while (strings->slots[slot] != offset) slot = (slot + 1) & mask;
+
+    unsigned int next = slot;
+    for (;;) {
+        next = (next + 1) & mask;
+        if (strings->slots[next] == 0) break;
+
+        unsigned int home = get_compact_entry(strings, strings->slots[next])->hash & mask;
+        if ((slot <= next) ? (slot < home && home <= next) : (slot < home || home <= next)) continue;
+
+        strings->slots[slot] = strings->slots[next];
+        slot = next;
+    }
+
+    strings->slots[slot] = 0;
+    strings->count -= 1;
+    strings->released += get_compact_entry_size(entry);
+}
+
+/*
+  * This function copies the live strings in a new blob when released entries
+  * are half of it, and rewrites the offsets of the nodes and hash slots.
+  * The blob is kept if malloc failed.
+*/
+static void pack_compact_strings(ProcCompactList *compact) {
+    ProcCompactStrings *strings = compact->strings;
+    if (strings->released < COMPACT_MINIMUM_RELEASED || strings->released * 2 < strings->length) return;
+
+    unsigned int size = strings->length - strings->released;
+    char *blob = malloc(size > 4096 ? size : 4096);
+    if (blob == NULL) return;
+
+    // the references of a copied entry are replaced by its new offset
+    unsigned int length = 0;
+    for (unsigned int position = 0; position < strings->length;) {
+        CompactString *entry = (CompactString *)(strings->blob + position);
+        unsigned int entry_size = get_compact_entry_size(entry);
+
+        if (entry->references) {
+            memcpy(blob + length, entry, entry_size);
+            entry->references = length + offsetof(CompactString, value);
+            length += entry_size;
+        }
+
+        position += entry_size;
+    }
+
+    for (unsigned int node = 0; node < compact->used; node += 1) {
+        ProcCompactNode *element = &compact->nodes[node];
+        if (element->executable) element->executable = get_compact_entry(strings, element->executable)->references;
+        if (element->cmdline) element->cmdline = get_compact_entry(strings, element->cmdline)->references;
+        if (element->user) element->user = get_compact_entry(strings, element->user)->references;
+    }
+
+    for (unsigned int slot = 0; slot < strings->slots_size; slot += 1) {
+        if (strings->slots[slot] != 0) strings->slots[slot] = get_compact_entry(strings, strings->slots[slot])->references;
+    }
+
+    free(strings->blob);
+    strings->blob = blob;
+    strings->length = length;
+    strings->size = size > 4096 ? size : 4096;
+    strings->released = 0;
+}
+
+/*
+  * This function returns the home slot of a PID in the compact list index (Fibonacci hashing).
+*/
+static unsigned int hash_compact_pid(ProcCompactList *compact, unsigned int pid) {
+    return (unsigned int)(pid * 2654435761u) >> compact->index_shift;
+}
+
+/*
+  * This function adds or replaces a node in the PID index (no resize).
+*/
+static void put_compact_pid(ProcCompactList *compact, unsigned int node) {
+    unsigned int mask = compact->index_size - 1;
+    unsigned int pid = compact->nodes[node].pid;
+    unsigned int slot = hash_compact_pid(compact, pid);
+
+    while (compact->index[slot] != PROC_COMPACT_NONE) {
+        if (compact->nodes[compact->index[slot]].pid == pid) {
+            compact->index[slot] = node;
+            return;
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    compact->index[slot] = node;
+}
+
+/*
+  * This function doubles the PID index of the compact list and re-inserts each node.
+  * This function returns 1 if malloc failed.
+*/
+static char grow_compact_index(ProcCompactList *compact) {
+    unsigned int size = compact->index_size ? compact->index_size * 2 : PID_INDEX_MINIMUM_SIZE;
+    unsigned int *index = malloc(size * sizeof(unsigned int));
+    if (index == NULL) return 1;
+
+    unsigned int *old_index = compact->index;
+    unsigned int old_size = compact->index_size;
+    memset(index, 0xff, size * sizeof(unsigned int));       // PROC_COMPACT_NONE
+
+    compact->index = index;
+    compact->index_size = size;
+    compact->index_shift = 32;
+    for (unsigned int value = size; value > 1; value >>= 1) compact->index_shift -= 1;
+
+    for (unsigned int slot = 0; slot < old_size; slot += 1) {
+        if (old_index[slot] != PROC_COMPACT_NONE) put_compact_pid(compact, old_index[slot]);
+    }
+
+    free(old_index);
+    return 0;
+}
+
+/*
+  * This function removes a node from the PID index (it may have been replaced by a node with the same PID).
+  * Linear probing without tombstones: following slots are shifted back.
+*/
+static void unindex_compact_pid(ProcCompactList *compact, unsigned int node) {
+    unsigned int mask = compact->index_size - 1;
+    unsigned int slot = hash_compact_pid(compact, compact->nodes[node].pid);
+
+    while (compact->index[slot] != node) {
+        if (compact->index[slot] == PROC_COMPACT_NONE) return;
+        slot = (slot + 1) & mask;
+    }
+
+    unsigned int next = slot;
+    for (;;) {
+        next = (next + 1) & mask;
+        if (compact->index[next] == PROC_COMPACT_NONE) break;
+
+        unsigned int home = hash_compact_pid(compact, compact->nodes[compact->index[next]].pid);
+        if ((slot <= next) ? (slot < home && home <= next) : (slot < home || home <= next)) continue;
+
+        compact->index[slot] = compact->index[next];
+        slot = next;
+    }
+
+    compact->index[slot] = PROC_COMPACT_NONE;
+}
+
+/*
+  * This function initializes an empty compact list. The compact list is a
+  * storage form: nodes are added, removed and found by PID, other list
+  * functions (sort, query, snapshot...) work on expand_proc_compact copies.
+*/
+void init_proc_compact(ProcCompactList *compact) {
+    compact->nodes = NULL;
+    compact->length = 0;
+    compact->used = 0;
+    compact->size = 0;
+    compact->first = PROC_COMPACT_NONE;
+    compact->last = PROC_COMPACT_NONE;
+    compact->free = PROC_COMPACT_NONE;
+    compact->index = NULL;
+    compact->index_size = 0;
+    compact->index_shift = 32;
+    compact->strings = NULL;
+}
+
+/*
+  * This function frees the nodes, PID index and strings of a compact list.
+*/
+void free_proc_compact(ProcCompactList *compact) {
+    if (compact->strings != NULL) destroy_compact_strings(compact->strings);
+    free(compact->nodes);
+    free(compact->index);
+    init_proc_compact(compact);
+}
+
+/*
+  * This function adds a zeroed node with this PID at the end of the compact
+  * list and returns its index, removed nodes are reused first. The array may
+  * move: node pointers are invalidated, indexes are not. PIDs should be unique
+  * and not changed after (they are indexed).
+  * This function returns PROC_COMPACT_NONE if malloc failed.
+*/
+unsigned int new_proc_compact(ProcCompactList *compact, unsigned int pid) {
+    if ((compact->length + 1) * 2 > compact->index_size && grow_compact_index(compact)) return PROC_COMPACT_NONE;
+    unsigned int node = compact->free;
+
+    if (node != PROC_COMPACT_NONE) {
+        compact->free = compact->nodes[node].next;
+    } else {
+        if (compact->used == compact->size) {
+            unsigned int size = compact->size ? compact->size * 2 : POOL_DEFAULT_CHUNK_SIZE;
+            ProcCompactNode *nodes = realloc(compact->nodes, size * sizeof(ProcCompactNode));
+            if (nodes == NULL) return PROC_COMPACT_NONE;
+
+            compact->nodes = nodes;
+            compact->size = size;
+        }
+
+        node = compact->used++;
+    }
+
+    ProcCompactNode *element = &compact->nodes[node];
+    memset(element, 0, sizeof(ProcCompactNode));
+    element->pid = pid;
+    element->next = PROC_COMPACT_NONE;
+    element->precedent = compact->last;
+
+    if (compact->last != PROC_COMPACT_NONE) {
+        compact->nodes[compact->last].next = node;
+    } else {
+        compact->first = node;
+    }
+
+    compact->last = node;
+    compact->length += 1;
+    put_compact_pid(compact, node);
+    return node;
+}
+
+/*
+  * This function unlinks a node of the compact list, releases its strings
+  * and keeps its index for the next new_proc_compact.
+*/
+void remove_proc_compact(ProcCompactList *compact, unsigned int node) {
+    ProcCompactNode *element = &compact->nodes[node];
+    unindex_compact_pid(compact, node);
+
+    if (element->precedent != PROC_COMPACT_NONE) {
+        compact->nodes[element->precedent].next = element->next;
+    } else {
+        compact->first = element->next;
+    }
+
+    if (element->next != PROC_COMPACT_NONE) {
+        compact->nodes[element->next].precedent = element->precedent;
+    } else {
+        compact->last = element->precedent;
+    }
+
+    if (compact->strings != NULL) {
+        release_compact_string(compact->strings, element->executable);
+        release_compact_string(compact->strings, element->cmdline);
+        release_compact_string(compact->strings, element->user);
+    }
+
+    element->executable = 0;
+    element->cmdline = 0;
+    element->user = 0;
+    element->precedent = PROC_COMPACT_NONE;
+    element->next = compact->free;
+    compact->free = node;
+    compact->length -= 1;
+    if (compact->strings != NULL) pack_compact_strings(compact);
+}
+
+/*
+  * This function sets executable, cmdline and user (NULL allowed, strings
+  * of the same compact list too) of a node with copies interned in the
+  * compact list string table. String pointers of the list are invalidated.
+  * This function returns 1 if malloc failed.
+*/
+char set_proc_compact_strings(ProcCompactList *compact, unsigned int node, const char *executable, const char *cmdline, const char *user) {
+    if (compact->strings == NULL && (compact->strings = create_compact_strings()) == NULL) return 1;
+
+    ProcCompactStrings *strings = compact->strings;
+    unsigned int values[3] = {0, 0, 0};
+    const char *sources[3] = {executable, cmdline, user};
+
+    // strings of the table are referenced by offset first, interning may move the blob
+    for (unsigned int field = 0; field < 3; field += 1) {
+        if (sources[field] == NULL || sources[field] < strings->blob || sources[field] >= strings->blob + strings->length) continue;
+        values[field] = sources[field] - strings->blob;
+        get_compact_entry(strings, values[field])->references += 1;
+    }
+
+    for (unsigned int field = 0; field < 3; field += 1) {
+        if (sources[field] == NULL || values[field] != 0) continue;
+        values[field] = intern_compact_string(strings, sources[field]);
+
+        if (values[field] == 0) {
+            for (field = 0; field < 3; field += 1) release_compact_string(strings, values[field]);
+            return 1;
+        }
+    }
+
+    ProcCompactNode *element = &compact->nodes[node];
+    release_compact_string(strings, element->executable);
+    release_compact_string(strings, element->cmdline);
+    release_compact_string(strings, element->user);
+    element->executable = values[0];
+    element->cmdline = values[1];
+    element->user = values[2];
+    pack_compact_strings(compact);
+    return 0;
+}
+
+/*
+  * This function returns the string of an offset of a node (0: NULL),
+  * valid until the next change of the compact list strings.
+*/
+const char *get_proc_compact_string(ProcCompactList *compact, unsigned int offset) {
+    if (offset == 0) return NULL;
+    return compact->strings->blob + offset;
+}
+
+/*
+  * This function returns the index of the node with this PID in O(1),
+  * PROC_COMPACT_NONE if there is none.
+*/
+unsigned int get_proc_compact_pid(ProcCompactList *compact, unsigned int pid) {
+    if (compact->index_size == 0) return PROC_COMPACT_NONE;
+
+    unsigned int mask = compact->index_size - 1;
+    unsigned int slot = hash_compact_pid(compact, pid);
+
+    while (compact->index[slot] != PROC_COMPACT_NONE) {
+        if (compact->nodes[compact->index[slot]].pid == pid) return compact->index[slot];
+        slot = (slot + 1) & mask;
+    }
+
+    return PROC_COMPACT_NONE;
+}
+
+/*
+  * This function adds a copy of each process of the list at the end of the
+  * compact list (threads are not copied, the timestamp is rounded to the
+  * nanosecond).
+  * This function returns 1 if malloc failed.
+*/
+char compact_proc_list(ProcCompactList *compact, StartProcList *list) {
+    for (ProcessElementList *element = list->first; element != NULL; element = element->next) {
+        unsigned int node = new_proc_compact(compact, element->pid);
+        if (node == PROC_COMPACT_NONE) return 1;
+
+        if (set_proc_compact_strings(compact, node, element->executable, element->cmdline, element->user)) {
+            remove_proc_compact(compact, node);
+            return 1;
+        }
+
+        ProcCompactNode *copy = &compact->nodes[node];
+        copy->cpu_time = element->cpu_time;
+        copy->start_timestamp = (long long)(element->start_timestamp * 1000000000.0L + 0.5L);
+        copy->ppid = element->ppid;
+        copy->cpu_usage = element->cpu_usage;
+        copy->memory_usage = element->memory_usage;
+        copy->tty = element->tty;
+        copy->flags = element->flags & (PROC_FLAG_PENDING_EXECUTABLE | PROC_FLAG_PENDING_CMDLINE | PROC_FLAG_PENDING_USER);
+    }
+
+    return 0;
+}
+
+/*
+  * This function adds a process at the end of the list for each node of the
+  * compact list, so the list functions (sort, query, snapshot...) can be used.
+  * This function returns 1 if malloc failed.
+*/
+char expand_proc_compact(ProcCompactList *compact, StartProcList *list) {
+    for (unsigned int node = compact->first; node != PROC_COMPACT_NONE; node = compact->nodes[node].next) {
+        ProcCompactNode *copy = &compact->nodes[node];
+        ProcessElementList *element = new_proc(list);
+        if (element == NULL) return 1;
+
+        if (set_proc_strings(list, element, get_proc_compact_string(compact, copy->executable), get_proc_compact_string(compact, copy->cmdline), get_proc_compact_string(compact, copy->user))) {
+            free_proc(list, element);
+            return 1;
+        }
+
+        element->cpu_time = copy->cpu_time;
+        element->start_timestamp = copy->start_timestamp / 1000000000.0L;
+        element->pid = copy->pid;
+        element->ppid = copy->ppid;
+        element->cpu_usage = copy->cpu_usage;
+        element->memory_usage = copy->memory_usage;
+        element->tty = copy->tty;
+        element->flags |= copy->flags;
+        add_proc(list, element);
+    }
+
+    return 0;
+}
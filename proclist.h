@@ -14,13 +14,42 @@
     along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
 
+#include <stdint.h>
+#include <stddef.h>
+
+#define PROC_FLAG_INTERNED 0x01        // executable, cmdline and user are owned by the list string table
+#define PROC_FLAG_SEEN     0x02        // internal to refresh_procs: process found in the current scan
+#define PROC_FLAG_EXITED   0x04        // process reported as exited by refresh_procs or apply_proc_events
+#define PROC_FLAG_THREADS  0x08        // threads are loaded, records owned by the list thread pool
+#define PROC_FLAG_PENDING_SHIFT      4
+#define PROC_FLAG_PENDING_EXECUTABLE 0x10  // executable not loaded yet (scan field mask)
+#define PROC_FLAG_PENDING_CMDLINE    0x20  // cmdline not loaded yet
+#define PROC_FLAG_PENDING_USER       0x40  // user not loaded yet
+
+#define PROC_FIELD_EXECUTABLE 0x01
+#define PROC_FIELD_CMDLINE    0x02
+#define PROC_FIELD_USER       0x04
+#define PROC_FIELD_ALL        0x07
+
+typedef struct ProcThread {
+    struct ProcThread *next;         // threads in /proc/<pid>/task order
+    unsigned long long cpu_time;     // utime + stime (clock ticks)
+    unsigned int tid;
+    int processor;                   // last CPU the thread ran on
+    char state;                      // R, S, D, Z, T...
+} ProcThread;
+
 typedef struct ProcessElementList {
     struct ProcessElementList *next;
     struct ProcessElementList *precedent;
 
     char tty;                        // 0: process haven't tty; 1: process have tty
-    float cpu_usage;
-    float memory_usage;
+    unsigned char flags;             // PROC_FLAG_* bits, cleared when a process not allocated by new_proc is linked
+    float cpu_usage;                 // percent of one CPU between the two last scans
+    float memory_usage;              // resident memory percent of MemTotal
+    unsigned long long cpu_time;     // utime + stime (clock ticks) at the last scan
+    struct ProcChunk *chunk;         // positional index chunk (NULL without positional index)
+    ProcThread *threads;             // loaded by load_proc_threads (PROC_FLAG_THREADS)
 
     char *executable;
     char *cmdline;
@@ -28,20 +57,257 @@ typedef struct ProcessElementList {
 
     unsigned int pid;
     unsigned int ppid;
+    unsigned int trigram_id;         // trigram index id (0: not indexed)
 
     long double start_timestamp;
 } ProcessElementList;
 
+typedef struct ProcPidIndex ProcPidIndex;
+typedef struct ProcPool ProcPool;
+typedef struct ProcStrings ProcStrings;
+typedef struct ProcScanner ProcScanner;
+typedef struct ProcPublisher ProcPublisher;
+typedef struct ProcPositions ProcPositions;
+typedef struct ProcHistory ProcHistory;
+typedef struct ProcEvents ProcEvents;
+typedef struct ProcQuery ProcQuery;
+typedef struct ProcTrigrams ProcTrigrams;
+typedef struct ProcCompactStrings ProcCompactStrings;
+
+#define PROC_MAX_READERS 64
+
 typedef struct StartProcList {
     unsigned int length;
     ProcessElementList *first;
     ProcessElementList *last;
     ProcessElementList *position;
+
+    ProcPidIndex *index;             // optional PID hash index (NULL: get_proc_pid walks the list)
+    ProcPool *pool;                  // optional node allocator (NULL: nodes are malloc/free)
+    ProcStrings *strings;            // optional intern table owning executable, cmdline and user strings
+    ProcScanner *scanner;            // /proc reader state, created by the first scan
+    ProcPositions *positions;        // optional chunk index for O(sqrt(n)) positional access
+    ProcPool *thread_pool;           // thread records allocator, created by the first load_proc_threads
+    ProcTrigrams *trigrams;          // optional trigram index for executable and cmdline search
 } StartProcList;
 
+typedef struct ProcDiff {
+    ProcessElementList **created;    // new processes, still in the list
+    unsigned int created_length;
+    unsigned int created_size;
+
+    ProcessElementList **exited;     // unlinked processes, freed by the next refresh or clean_proc_diff
+    unsigned int exited_length;
+    unsigned int exited_size;
+} ProcDiff;
+
+typedef struct ProcSnapshot {
+    unsigned int length;
+    double *start;                   // contiguous columns, one value per process
+    unsigned int *pid;
+    unsigned int *ppid;
+    float *cpu;
+    float *memory;
+    unsigned int *executable;        // offsets in strings, 0 is the empty string (NULL)
+    unsigned int *cmdline;
+    unsigned int *user;
+    char *tty;
+
+    char *strings;                   // NUL terminated strings blob, deduplicated by pointer
+    unsigned int strings_size;
+} ProcSnapshot;
+
+typedef struct ProcTreeSlot {
+    unsigned int pid;
+    unsigned int position;           // preorder position + 1, 0: empty slot
+} ProcTreeSlot;
+
+typedef struct ProcTree {
+    unsigned int length;
+    ProcessElementList **order;      // depth-first preorder, a subtree is contiguous
+    unsigned int *subtree_length;    // by position: processes in the subtree (itself included)
+    unsigned int *parent;            // by position: parent position, (unsigned int)-1 for roots
+    double *cpu_sums;                // prefix sums by position (length + 1 values)
+    double *memory_sums;
+
+    ProcTreeSlot *slots;             // PID -> position hash table
+    unsigned int slots_size;         // power of two
+} ProcTree;
+
+typedef char (*ProcFilter)(ProcessElementList *element, void *data);   // returns 1 to keep the process
+typedef int (*ProcCompare)(const ProcessElementList *first, const ProcessElementList *second);
+
+typedef struct ProcTopK {
+    ProcessElementList **heap;       // the parent compares after its children: the root is evicted first
+    unsigned int length;
+    unsigned int k;
+    ProcCompare compare;
+} ProcTopK;
+
+typedef struct ProcSortedView {
+    ProcessElementList **processes; // sorted processes of the list
+    unsigned int length;
+    unsigned int size;
+    ProcCompare compare;
+    ProcessElementList **buffer;     // misplaced and created processes during updates
+    unsigned int buffer_size;
+} ProcSortedView;
+
+typedef struct ProcIterator {
+    StartProcList *list;
+    ProcessElementList *position;    // iterator-local cursor, the list position is not used
+    ProcFilter filter;               // NULL: every process
+    void *data;
+} ProcIterator;
+
+typedef struct ProcReader {
+    ProcPublisher *publisher;
+    unsigned int slot;
+    ProcSnapshot *snapshot;          // acquired snapshot, reader-local iteration by index
+    unsigned long long version;      // publication number of the acquired snapshot
+} ProcReader;
+
+#define PROC_FILE_MAGIC "PROCLIST"
+#define PROC_FILE_VERSION 1
+
+typedef struct ProcFileHeader {     // binary snapshot file, native byte order
+    char magic[8];                   // PROC_FILE_MAGIC
+    uint32_t version;                // PROC_FILE_VERSION
+    uint32_t record_size;            // sizeof(ProcRecord)
+    uint32_t length;                 // records count
+    uint32_t strings_size;           // string table size, ends with a NUL byte
+    uint64_t records_offset;
+    uint64_t strings_offset;
+    double timestamp;                // snapshot write time
+    uint8_t reserved[16];
+} ProcFileHeader;
+
+typedef struct ProcRecord {          // fixed width process record
+    double start_timestamp;
+    uint32_t pid;
+    uint32_t ppid;
+    float cpu_usage;
+    float memory_usage;
+    uint32_t executable;             // offsets in the string table, 0 is the empty string
+    uint32_t cmdline;
+    uint32_t user;
+    uint8_t tty;
+    uint8_t reserved[11];
+} ProcRecord;
+
+typedef struct ProcSnapshotFile {
+    void *map;
+    size_t size;
+    const ProcFileHeader *header;
+    const ProcRecord *records;       // zero-copy records in the mapped file
+    const char *strings;
+    unsigned int length;
+} ProcSnapshotFile;
+
+#define PROC_COMPACT_NONE ((unsigned int)-1)
+
+typedef struct ProcCompactNode {
+    unsigned long long cpu_time;
+    long long start_timestamp;       // nanoseconds since the epoch
+    unsigned int executable;         // offsets in the compact list string table, 0: NULL
+    unsigned int cmdline;
+    unsigned int user;
+    unsigned int next;               // node indexes, PROC_COMPACT_NONE: no node
+    unsigned int precedent;
+    unsigned int pid;                // set by new_proc_compact (PID index)
+    unsigned int ppid;
+    float cpu_usage;
+    float memory_usage;
+    char tty;
+    unsigned char flags;             // PROC_FLAG_PENDING_* bits
+} ProcCompactNode;
+
+typedef struct ProcCompactList {
+    ProcCompactNode *nodes;          // one growable array, indexes are stable (pointers are not)
+    unsigned int length;             // linked nodes
+    unsigned int used;               // nodes used in the array (linked or free)
+    unsigned int size;
+    unsigned int first;
+    unsigned int last;
+    unsigned int free;               // removed nodes linked by next
+    unsigned int *index;             // nodes by PID hash, PROC_COMPACT_NONE: empty slot
+    unsigned int index_size;         // power of two, at least twice length
+    unsigned int index_shift;        // 32 - log2(index_size)
+    ProcCompactStrings *strings;
+} ProcCompactList;
+
 void init_proc_list(StartProcList *list);
 void clean_proc_list(StartProcList *list);
 
+char enable_proc_pid_index(StartProcList *list);
+char enable_proc_positions(StartProcList *list);
+char enable_proc_trigrams(StartProcList *list);
+unsigned int search_procs(StartProcList *list, const char *text, ProcessElementList **matches, unsigned int size);
+char enable_proc_pool(StartProcList *list, unsigned int chunk_size);
+char init_proc_list_with_pool(StartProcList *list, unsigned int chunk_size);
+
+ProcessElementList *new_proc(StartProcList *list);
+void free_proc(StartProcList *list, ProcessElementList *element);
+unsigned int count_proc_pool_chunks(StartProcList *list);
+
+char enable_proc_strings(StartProcList *list);
+char set_proc_strings(StartProcList *list, ProcessElementList *element, const char *executable, const char *cmdline, const char *user);
+unsigned int count_proc_strings(StartProcList *list);
+
+char scan_procs(StartProcList *list);
+char scan_procs_fields(StartProcList *list, unsigned char fields);
+char scan_procs_parallel(StartProcList *list, unsigned int threads);
+char load_proc_fields(StartProcList *list, ProcessElementList *element, unsigned char fields);
+char *get_proc_executable(StartProcList *list, ProcessElementList *element);
+char *get_proc_cmdline(StartProcList *list, ProcessElementList *element);
+char *get_proc_user(StartProcList *list, ProcessElementList *element);
+const char *resolve_proc_user(StartProcList *list, unsigned int uid);
+char load_proc_threads(StartProcList *list, ProcessElementList *element);
+void free_proc_threads(StartProcList *list, ProcessElementList *element);
+unsigned int count_proc_threads(ProcessElementList *element);
+
+void init_proc_diff(ProcDiff *diff);
+char refresh_procs(StartProcList *list, ProcDiff *diff);
+ProcEvents *open_proc_events(void);
+void close_proc_events(ProcEvents *events);
+int get_proc_events_fd(ProcEvents *events);
+char apply_proc_events(StartProcList *list, ProcEvents *events, ProcDiff *diff);
+void clean_proc_diff(StartProcList *list, ProcDiff *diff);
+
+char export_proc_snapshot(StartProcList *list, ProcSnapshot *snapshot);
+void free_proc_snapshot(ProcSnapshot *snapshot);
+double sum_snapshot_values(const float *values, unsigned int length);
+unsigned int filter_snapshot_values(const float *values, unsigned int length, float threshold, unsigned int *indexes);
+unsigned int top_snapshot_values(const float *values, unsigned int length, unsigned int k, unsigned int *indexes);
+
+char build_proc_tree(StartProcList *list, ProcTree *tree);
+void free_proc_tree(ProcTree *tree);
+unsigned int get_proc_subtree(ProcTree *tree, unsigned int pid, ProcessElementList ***processes);
+unsigned int get_proc_children(ProcTree *tree, unsigned int pid, ProcessElementList **children, unsigned int size);
+ProcessElementList *get_proc_tree_parent(ProcTree *tree, unsigned int pid);
+double get_proc_subtree_cpu(ProcTree *tree, unsigned int pid);
+double get_proc_subtree_memory(ProcTree *tree, unsigned int pid);
+
+char write_proc_snapshot_file(StartProcList *list, const char *path);
+char open_proc_snapshot_file(ProcSnapshotFile *file, const char *path);
+const ProcRecord *get_proc_record(ProcSnapshotFile *file, unsigned int index);
+const char *get_proc_record_string(ProcSnapshotFile *file, uint32_t offset);
+void close_proc_snapshot_file(ProcSnapshotFile *file);
+
+ProcHistory *create_proc_history(unsigned int capacity);
+void destroy_proc_history(ProcHistory *history);
+char record_proc_history(ProcHistory *history, StartProcList *list);
+char get_proc_history_ticks(ProcHistory *history, unsigned long long *first, unsigned long long *last);
+char restore_proc_history(ProcHistory *history, unsigned long long tick, StartProcList *list);
+
+ProcPublisher *create_proc_publisher(void);
+void destroy_proc_publisher(ProcPublisher *publisher);
+char publish_proc_list(ProcPublisher *publisher, StartProcList *list);
+char register_proc_reader(ProcPublisher *publisher, ProcReader *reader);
+void unregister_proc_reader(ProcReader *reader);
+ProcSnapshot *acquire_proc_snapshot(ProcReader *reader);
+void release_proc_snapshot(ProcReader *reader);
+
 void add_proc(StartProcList *list, ProcessElementList *element);
 ProcessElementList *pop_proc(StartProcList *list);
 ProcessElementList *popleft_proc(StartProcList *list);
@@ -49,6 +315,9 @@ ProcessElementList *popleft_proc(StartProcList *list);
 char insert_proc(StartProcList *list, ProcessElementList *element, unsigned int index);
 void insert_after_proc(StartProcList *list, ProcessElementList *element, ProcessElementList *before);
 void insert_before_proc(StartProcList *list, ProcessElementList *element, ProcessElementList *after);
+void add_procs(StartProcList *list, ProcessElementList **elements, unsigned int count);
+char splice_proc_list(StartProcList *list, StartProcList *other, ProcessElementList *before);
+char split_proc_list(StartProcList *list, ProcessElementList *element, StartProcList *other);
 
 char remove_proc_index(StartProcList *list, unsigned int index);
 void remove_proc(StartProcList *list, ProcessElementList *element);
@@ -60,3 +329,44 @@ ProcessElementList *get_proc_pid(StartProcList *list, unsigned int pid);
 
 void goto_first_position (StartProcList *list);
 void goto_last_position (StartProcList *list);
+
+int compare_proc_pid(const ProcessElementList *first, const ProcessElementList *second);
+int compare_proc_start_timestamp(const ProcessElementList *first, const ProcessElementList *second);
+int compare_proc_cpu_usage(const ProcessElementList *first, const ProcessElementList *second);
+int compare_proc_memory_usage(const ProcessElementList *first, const ProcessElementList *second);
+void sort_proc_list(StartProcList *list, ProcCompare compare);
+
+char init_proc_view(ProcSortedView *view, StartProcList *list, ProcCompare compare);
+char update_proc_view(ProcSortedView *view, ProcDiff *diff);
+void free_proc_view(ProcSortedView *view);
+
+char init_proc_top(ProcTopK *top, unsigned int k, ProcCompare compare);
+void push_proc_top(ProcTopK *top, ProcessElementList *element);
+void update_proc_top(ProcTopK *top, ProcessElementList *element);
+void remove_proc_top(ProcTopK *top, ProcessElementList *element);
+void fill_proc_top(ProcTopK *top, StartProcList *list);
+unsigned int get_proc_top(ProcTopK *top, ProcessElementList **processes);
+void free_proc_top(ProcTopK *top);
+
+void init_proc_iterator(StartProcList *list, ProcIterator *iterator);
+void set_proc_iterator_filter(ProcIterator *iterator, ProcFilter filter, void *data);
+ProcessElementList *get_next_iterator_proc(ProcIterator *iterator);
+ProcessElementList *get_precedent_iterator_proc(ProcIterator *iterator);
+char seek_iterator_pid(ProcIterator *iterator, unsigned int pid);
+void goto_first_iterator_position(ProcIterator *iterator);
+void goto_last_iterator_position(ProcIterator *iterator);
+
+ProcQuery *compile_proc_query(const char *expression);
+void free_proc_query(ProcQuery *query);
+char match_proc_query(ProcessElementList *element, void *query);
+unsigned int select_proc_query(StartProcList *list, ProcQuery *query, ProcessElementList **matches, unsigned int size);
+
+void init_proc_compact(ProcCompactList *compact);
+void free_proc_compact(ProcCompactList *compact);
+unsigned int new_proc_compact(ProcCompactList *compact, unsigned int pid);
+void remove_proc_compact(ProcCompactList *compact, unsigned int node);
+char set_proc_compact_strings(ProcCompactList *compact, unsigned int node, const char *executable, const char *cmdline, const char *user);
+const char *get_proc_compact_string(ProcCompactList *compact, unsigned int offset);
+unsigned int get_proc_compact_pid(ProcCompactList *compact, unsigned int pid);
+char compact_proc_list(ProcCompactList *compact, StartProcList *list);
+char expand_proc_compact(ProcCompactList *compact, StartProcList *list);
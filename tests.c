@@ -15,9 +15,19 @@
 */
 
 #include  "proclist.h"
+#include  "fixtures.h"
 #include <stddef.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pwd.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
 
 /*
   * This function is used for tests and prints an ordered PID list.
@@ -90,10 +100,1671 @@ char check (StartProcList *list) {
     return 0;
 }
 
+/*
+  * This function tests the PID hash index maintenance.
+*/
+char test_pid_index(void) {
+    StartProcList *list = malloc(sizeof(StartProcList));
+    if (list == NULL) return 1;
+    init_proc_list(list);
+
+    for (unsigned int pid = 1; pid <= 50; pid += 1) add_proc(list, make_proc(pid, 0));
+
+    if (enable_proc_pid_index(list)) {
+        puts("Error in enable_proc_pid_index");
+        return 35;
+    }
+
+    for (unsigned int pid = 51; pid <= 1000; pid += 1) add_proc(list, make_proc(pid, 0));
+    insert_proc(list, make_proc(5000, 0), 10);
+    insert_after_proc(list, make_proc(5001, 0), list->last);
+    insert_before_proc(list, make_proc(5002, 0), list->first);
+
+    for (unsigned int pid = 1; pid <= 1000; pid += 1) {
+        ProcessElementList *process = get_proc_pid(list, pid);
+        if (process == NULL || process->pid != pid) {
+            printf("Error in get_proc_pid with index, PID %u not found\n", pid);
+            return 36;
+        }
+    }
+
+    if (get_proc_pid(list, 5000) == NULL || get_proc_pid(list, 5001) != list->last || get_proc_pid(list, 5002) != list->first) {
+        puts("Error in PID index after insert_proc, insert_after_proc or insert_before_proc");
+        return 37;
+    }
+
+    free(pop_proc(list));
+    free(popleft_proc(list));
+    remove_proc(list, get_proc_pid(list, 500));
+    remove_proc_index(list, 10);                 // PID 5000 is at index 10 (5002 has been popped)
+
+    if (get_proc_pid(list, 5001) != NULL || get_proc_pid(list, 5002) != NULL || get_proc_pid(list, 500) != NULL || get_proc_pid(list, 5000) != NULL) {
+        puts("Error in PID index, removed process is still indexed");
+        return 38;
+    }
+
+    for (unsigned int pid = 1; pid <= 1000; pid += 1) {
+        if (pid != 500 && get_proc_pid(list, pid) == NULL) {
+            printf("Error in PID index after removes, PID %u not found\n", pid);
+            return 39;
+        }
+    }
+
+    while (list->length) free(pop_proc(list));
+    if (list->first != NULL || get_proc_pid(list, 1) != NULL) {
+        puts("Error in PID index or pop_proc on empty list");
+        return 40;
+    }
+
+    clean_proc_list(list);
+    return 0;
+}
+
+/*
+  * This function tests the node pool allocation mode.
+*/
+char test_pool(void) {
+    StartProcList *list = malloc(sizeof(StartProcList));
+    if (list == NULL) return 1;
+
+    if (init_proc_list_with_pool(list, 4)) {
+        puts("Error in init_proc_list_with_pool");
+        return 41;
+    }
+
+    for (unsigned int pid = 0; pid < 100; pid += 1) {
+        ProcessElementList *process = new_proc(list);
+        if (process == NULL || process->next != NULL || process->pid != 0) {
+            puts("Error in new_proc, process is NULL or not zeroed");
+            return 42;
+        }
+        process->pid = pid;
+        add_proc(list, process);
+    }
+
+    ProcessElementList *removed = get_proc(list, 50);
+    remove_proc(list, removed);
+    ProcessElementList *recycled = new_proc(list);
+
+    if (recycled != removed) {
+        puts("Error in remove_proc or new_proc, removed pooled process is not recycled");
+        return 43;
+    }
+
+    add_proc(list, recycled);
+    add_proc(list, make_proc(1000, 0));          // malloc process in a pooled list
+    remove_proc_index(list, 0);
+    free_proc(list, pop_proc(list));
+    free_proc(list, popleft_proc(list));
+
+    if (list->length != 98 || list->first->pid != 2 || list->last->pid != 0) {
+        printf("Error in pooled list, length %u first %u last %u\n", list->length, list->first->pid, list->last->pid);
+        return 44;
+    }
+
+    add_proc(list, make_proc(1001, 0));
+
+    ProcessElementList *garbage = malloc(sizeof(ProcessElementList));  // caller node, flags and threads not initialized
+    memset(garbage, 0xff, sizeof(ProcessElementList));
+    garbage->executable = garbage->cmdline = garbage->user = NULL;
+    add_proc(list, garbage);
+    if (garbage->flags != 0 || set_proc_strings(list, garbage, "init", NULL, NULL)) {
+        puts("Error in add_proc, flags of a malloc process are kept");
+        return 135;
+    }
+
+    free_proc(list, pop_proc(list));
+    add_proc(list, make_proc(1002, 0));
+    clean_proc_list(list);
+    return 0;
+}
+
+/*
+  * This function tests the string intern table.
+*/
+char test_strings(void) {
+    StartProcList *list = malloc(sizeof(StartProcList));
+    if (list == NULL) return 1;
+    init_proc_list_with_pool(list, 0);
+
+    char *users[] = {"root", "postgres", "www-data"};
+    char cmdline[64];
+
+    for (unsigned int pid = 0; pid < 1000; pid += 1) {
+        ProcessElementList *process = new_proc(list);
+        process->pid = pid;
+        snprintf(cmdline, sizeof(cmdline), "/usr/bin/python3 worker.py --id %u", pid % 10);
+
+        if (set_proc_strings(list, process, "/usr/bin/python3", cmdline, users[pid % 3])) {
+            puts("Error in set_proc_strings");
+            return 45;
+        }
+
+        add_proc(list, process);
+    }
+
+    if (count_proc_strings(list) != 14) {
+        printf("Error in set_proc_strings, %u strings interned instead of 14\n", count_proc_strings(list));
+        return 46;
+    }
+
+    if (get_proc(list, 0)->user != get_proc(list, 999)->user || get_proc(list, 1)->executable != get_proc(list, 2)->executable) {
+        puts("Error in set_proc_strings, equal strings are not the same pointer");
+        return 47;
+    }
+
+    ProcessElementList *process = list->first;
+    set_proc_strings(list, process, "/usr/sbin/init", "init", "root");
+    if (count_proc_strings(list) != 16 || strcmp(process->cmdline, "init")) {
+        printf("Error in set_proc_strings replacing strings (%u strings)\n", count_proc_strings(list));
+        return 48;
+    }
+
+    while (list->length) remove_proc(list, list->first);
+
+    if (count_proc_strings(list) != 0) {
+        printf("Error in remove_proc, %u strings are still interned\n", count_proc_strings(list));
+        return 49;
+    }
+
+    process = new_proc(list);
+    set_proc_strings(list, process, "bash", "-bash", NULL);
+    add_proc(list, process);
+    clean_proc_list(list);
+    return 0;
+}
+
+/*
+  * This function tests the /proc scanner with the current process.
+*/
+char test_scan(const char *program) {
+    StartProcList *list = malloc(sizeof(StartProcList));
+    if (list == NULL) return 1;
+    init_proc_list_with_pool(list, 0);
+
+    if (scan_procs(list)) {
+        puts("Error in scan_procs");
+        return 50;
+    }
+
+    ProcessElementList *process = get_proc_pid(list, getpid());
+    if (process == NULL) {
+        printf("Error in scan_procs, current process not found in %u processes\n", list->length);
+        return 51;
+    }
+
+    struct passwd *user = getpwuid(getuid());
+    const char *name = strrchr(program, '/') != NULL ? strrchr(program, '/') + 1 : program;
+    if (process->ppid != (unsigned int)getppid() || strcmp(process->user, user->pw_name) || strstr(process->executable, name) == NULL || strncmp(process->cmdline, program, strlen(program))) {
+        printf("Error in scan_procs: ppid %u user %s executable %s cmdline %s\n", process->ppid, process->user, process->executable, process->cmdline);
+        return 52;
+    }
+
+    if (process->start_timestamp < 1000000000.0 || process->start_timestamp > time(NULL) + 1) {
+        printf("Error in scan_procs, start timestamp %Lf\n", process->start_timestamp);
+        return 53;
+    }
+
+    clean_proc_list(list);
+    return 0;
+}
+
+/*
+  * This function tests the parallel /proc scanner against the current process.
+*/
+char test_parallel_scan(const char *program) {
+    StartProcList *list = malloc(sizeof(StartProcList));
+    if (list == NULL) return 1;
+    init_proc_list_with_pool(list, 0);
+    enable_proc_pid_index(list);
+
+    if (scan_procs_parallel(list, 4)) {
+        puts("Error in scan_procs_parallel");
+        return 104;
+    }
+
+    for (ProcessElementList *process = list->first; process != NULL && process->next != NULL; process = process->next) {
+        if (process->pid >= process->next->pid) {
+            printf("Error in scan_procs_parallel, PID %u before %u\n", process->pid, process->next->pid);
+            return 105;
+        }
+    }
+
+    ProcessElementList *process = get_proc_pid(list, getpid());
+    if (process == NULL || process->ppid != (unsigned int)getppid() || strncmp(process->cmdline, program, strlen(program))) {
+        printf("Error in scan_procs_parallel, current process not found in %u processes\n", list->length);
+        return 106;
+    }
+
+    // shards intern in private tables, equal strings must still share one copy
+    for (ProcessElementList *first = list->first; first != NULL; first = first->next) {
+        for (ProcessElementList *second = first->next; second != NULL; second = second->next) {
+            if ((first->user != second->user && strcmp(first->user, second->user) == 0) || (first->executable != second->executable && strcmp(first->executable, second->executable) == 0)) {
+                printf("Error in scan_procs_parallel, PID %u and %u do not share their strings\n", first->pid, second->pid);
+                return 142;
+            }
+        }
+    }
+
+    // removed processes are reused by the next scans, the pool does not grow
+    unsigned int chunks = 0;
+    for (unsigned int round = 0; round < 100; round += 1) {
+        while (list->length) remove_proc(list, list->first);
+        if (scan_procs_parallel(list, 4)) return 104;
+        if (round == 0) chunks = count_proc_pool_chunks(list);
+    }
+
+    if (count_proc_pool_chunks(list) > chunks + 1) {
+        printf("Error in scan_procs_parallel, pool grew from %u to %u chunks\n", chunks, count_proc_pool_chunks(list));
+        return 138;
+    }
+
+    clean_proc_list(list);
+    return 0;
+}
+
+/*
+  * This function tests scans with a field mask and lazy string loading.
+*/
+char test_lazy_fields(const char *program) {
+    StartProcList *list = malloc(sizeof(StartProcList));
+    if (list == NULL) return 1;
+    init_proc_list_with_pool(list, 0);
+    enable_proc_pid_index(list);
+
+    if (scan_procs_fields(list, PROC_FIELD_USER)) {
+        puts("Error in scan_procs_fields");
+        return 110;
+    }
+
+    ProcessElementList *process = get_proc_pid(list, getpid());
+    struct passwd *user = getpwuid(getuid());
+    if (process == NULL || process->executable != NULL || process->cmdline != NULL || strcmp(process->user, user->pw_name) || (process->flags & (PROC_FLAG_PENDING_EXECUTABLE | PROC_FLAG_PENDING_CMDLINE | PROC_FLAG_PENDING_USER)) != (PROC_FLAG_PENDING_EXECUTABLE | PROC_FLAG_PENDING_CMDLINE)) {
+        puts("Error in scan_procs_fields, unexpected loaded fields");
+        return 111;
+    }
+
+    const char *name = strrchr(program, '/') != NULL ? strrchr(program, '/') + 1 : program;
+    if (strncmp(get_proc_cmdline(list, process), program, strlen(program)) || process->executable != NULL || strstr(get_proc_executable(list, process), name) == NULL || strcmp(get_proc_user(list, process), user->pw_name) || (process->flags & (PROC_FLAG_PENDING_EXECUTABLE | PROC_FLAG_PENDING_CMDLINE))) {
+        puts("Error in lazy field loading");
+        return 112;
+    }
+
+    process->start_timestamp += 1;                  // PID reused: nothing is loaded
+    process->flags |= PROC_FLAG_PENDING_CMDLINE;
+    if (load_proc_fields(list, process, PROC_FIELD_ALL) == 0) {
+        puts("Error in load_proc_fields, fields of another process are loaded");
+        return 113;
+    }
+
+    clean_proc_list(list);
+    return 0;
+}
+
+/*
+  * This function tests the UID to user name cache.
+*/
+char test_users(void) {
+    StartProcList *list = malloc(sizeof(StartProcList));
+    if (list == NULL) return 1;
+    init_proc_list(list);
+
+    struct passwd *user = getpwuid(getuid());
+    const char *name = resolve_proc_user(list, getuid());
+    if (name == NULL || strcmp(name, user->pw_name) || resolve_proc_user(list, getuid()) != name) {
+        puts("Error in resolve_proc_user");
+        return 114;
+    }
+
+    for (unsigned int uid = 4000000000u; uid < 4000000200u; uid += 1) {
+        char decimal[16];
+        snprintf(decimal, sizeof(decimal), "%u", uid);
+        if (strcmp(resolve_proc_user(list, uid), decimal)) {
+            puts("Error in resolve_proc_user for an unknown UID");
+            return 115;
+        }
+    }
+
+    if (strcmp(resolve_proc_user(list, getuid()), user->pw_name)) {
+        puts("Error in resolve_proc_user after cache growth");
+        return 116;
+    }
+
+    // processes of a UID share the name interned once in the list table
+    if (scan_procs_fields(list, PROC_FIELD_USER)) return 1;
+    const char *shared = NULL;
+    for (ProcessElementList *element = list->first; element != NULL; element = element->next) {
+        if (element->user == NULL || strcmp(element->user, user->pw_name)) continue;
+        if (shared == NULL) shared = element->user;
+
+        if (element->user != shared) {
+            puts("Error in scan_procs_fields: user name not shared");
+            return 145;
+        }
+    }
+
+    clean_proc_list(list);
+    return 0;
+}
+
+/*
+  * This function is a thread waiting until the test releases it.
+*/
+void *idle_thread(void *data) {
+    pthread_mutex_t *mutex = data;
+    pthread_mutex_lock(mutex);
+    pthread_mutex_unlock(mutex);
+    return NULL;
+}
+
+/*
+  * This function tests lazy thread records with threads of the current process.
+*/
+char test_threads(void) {
+    StartProcList *list = malloc(sizeof(StartProcList));
+    if (list == NULL) return 1;
+    init_proc_list_with_pool(list, 0);
+    scan_procs(list);
+
+    pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+    pthread_t threads[3];
+    pthread_mutex_lock(&mutex);
+    for (unsigned int thread = 0; thread < 3; thread += 1) pthread_create(&threads[thread], NULL, idle_thread, &mutex);
+
+    ProcessElementList *process = get_proc_pid(list, getpid());
+    if (process == NULL || process->threads != NULL || count_proc_threads(process)) {
+        puts("Error in scan_procs, threads are loaded");
+        return 107;
+    }
+
+    for (unsigned int load = 0; load < 2; load += 1) {
+        if (load_proc_threads(list, process) || count_proc_threads(process) != 4 || process->threads->tid != (unsigned int)getpid() || process->threads->state != 'R') {
+            printf("Error in load_proc_threads, %u threads\n", count_proc_threads(process));
+            return 108;
+        }
+    }
+
+    pthread_mutex_unlock(&mutex);
+    for (unsigned int thread = 0; thread < 3; thread += 1) pthread_join(threads[thread], NULL);
+
+    free_proc_threads(list, process);
+    if (process->threads != NULL || count_proc_threads(process) || (load_proc_threads(list, process) == 0 && count_proc_threads(process) != 1)) {
+        puts("Error in free_proc_threads");
+        return 109;
+    }
+
+    process->start_timestamp += 1;                  // same PID, another process
+    free_proc_threads(list, process);
+    if (load_proc_threads(list, process) == 0 || process->threads != NULL) {
+        puts("Error in load_proc_threads, threads of a reused PID are loaded");
+        return 139;
+    }
+
+    remove_proc(list, process);
+    clean_proc_list(list);
+    return 0;
+}
+
+/*
+  * This function tests the incremental refresh with a child process.
+*/
+char test_refresh(void) {
+    StartProcList *list = malloc(sizeof(StartProcList));
+    if (list == NULL) return 1;
+    init_proc_list_with_pool(list, 0);
+
+    ProcessElementList *fake = new_proc(list);
+    fake->pid = getpid();
+    fake->start_timestamp = 1;                   // same PID, other start: PID reused
+    add_proc(list, fake);
+
+    ProcDiff diff;
+    init_proc_diff(&diff);
+
+    if (refresh_procs(list, &diff)) {
+        puts("Error in refresh_procs");
+        return 54;
+    }
+
+    ProcessElementList *self = get_proc_pid(list, getpid());
+    if (diff.exited_length != 1 || diff.exited[0] != fake || !(fake->flags & PROC_FLAG_EXITED) || self == NULL || self == fake || diff.created_length != list->length) {
+        printf("Error in refresh_procs PID reuse: %u exited, %u created for %u processes\n", diff.exited_length, diff.created_length, list->length);
+        return 55;
+    }
+
+    pid_t child = fork();
+    if (child == 0) {
+        pause();
+        _exit(0);
+    }
+
+    refresh_procs(list, &diff);
+    if (!contains_proc(diff.created, diff.created_length, child) || contains_proc(diff.exited, diff.exited_length, getpid()) || get_proc_pid(list, getpid()) != self) {
+        printf("Error in refresh_procs with new child: %u created, %u exited\n", diff.created_length, diff.exited_length);
+        return 56;
+    }
+
+    kill(child, SIGKILL);
+    waitpid(child, NULL, 0);
+
+    refresh_procs(list, &diff);
+    if (!contains_proc(diff.exited, diff.exited_length, child) || contains_proc(diff.created, diff.created_length, child) || get_proc_pid(list, child) != NULL) {
+        printf("Error in refresh_procs with exited child: %u created, %u exited\n", diff.created_length, diff.exited_length);
+        return 57;
+    }
+
+    clean_proc_diff(list, &diff);
+    clean_proc_list(list);
+    return 0;
+}
+
+/*
+  * This function tests CPU and memory usage with a busy child process.
+*/
+char test_usage(void) {
+    StartProcList *list = malloc(sizeof(StartProcList));
+    if (list == NULL) return 1;
+    init_proc_list_with_pool(list, 0);
+
+    pid_t child = fork();
+    if (child == 0) {
+        for (;;) {}
+    }
+
+    refresh_procs(list, NULL);
+    ProcessElementList *busy = get_proc_pid(list, child);
+    if (busy == NULL || busy->cpu_usage != 0) {
+        puts("Error in refresh_procs, first scan CPU usage is not 0");
+        return 58;
+    }
+
+    usleep(300000);
+    refresh_procs(list, NULL);
+    ProcessElementList *self = get_proc_pid(list, getpid());
+
+    if (busy->cpu_usage < 10 || busy->cpu_usage > 100.5 || self->memory_usage <= 0 || self->memory_usage > 100) {
+        printf("Error in refresh_procs usage: child CPU %f, self memory %f\n", busy->cpu_usage, self->memory_usage);
+        return 59;
+    }
+
+    kill(child, SIGKILL);
+    waitpid(child, NULL, 0);
+    clean_proc_list(list);
+    return 0;
+}
+
+/*
+  * This function tests the struct-of-arrays snapshot and its helpers.
+*/
+char test_snapshot(void) {
+    StartProcList *list = malloc(sizeof(StartProcList));
+    if (list == NULL) return 1;
+    init_proc_list_with_pool(list, 0);
+
+    for (unsigned int pid = 0; pid < 100; pid += 1) {
+        ProcessElementList *process = new_proc(list);
+        process->pid = pid;
+        process->ppid = pid / 2;
+        process->cpu_usage = (pid * 37) % 100;
+        process->memory_usage = pid / 10.0;
+        process->start_timestamp = 1466607358.0 + pid;
+        set_proc_strings(list, process, "/usr/bin/python3", pid % 2 ? "python3 odd.py" : "python3 even.py", pid == 3 ? NULL : "root");
+        add_proc(list, process);
+    }
+
+    ProcSnapshot snapshot;
+    if (export_proc_snapshot(list, &snapshot)) {
+        puts("Error in export_proc_snapshot");
+        return 60;
+    }
+
+    if (snapshot.length != 100 || snapshot.pid[42] != 42 || snapshot.ppid[42] != 21 || snapshot.start[42] != 1466607400.0 || strcmp(snapshot.strings + snapshot.cmdline[43], "python3 odd.py") || snapshot.user[3] != 0 || strcmp(snapshot.strings + snapshot.user[4], "root")) {
+        puts("Error in export_proc_snapshot, wrong column values");
+        return 61;
+    }
+
+    if (snapshot.strings_size != 1 + sizeof("/usr/bin/python3") + sizeof("python3 odd.py") + sizeof("python3 even.py") + sizeof("root")) {
+        printf("Error in export_proc_snapshot, strings are not deduplicated (%u bytes)\n", snapshot.strings_size);
+        return 62;
+    }
+
+    double sum = sum_snapshot_values(snapshot.cpu, snapshot.length);
+    double expected = 0;
+    unsigned int above = 0;
+    for (unsigned int pid = 0; pid < 100; pid += 1) {
+        expected += (pid * 37) % 100;
+        above += (pid * 37) % 100 > 90;
+    }
+
+    unsigned int indexes[100];
+    if (sum != expected || filter_snapshot_values(snapshot.cpu, snapshot.length, 90, indexes) != above || snapshot.cpu[indexes[0]] <= 90) {
+        printf("Error in sum_snapshot_values or filter_snapshot_values (sum %f)\n", sum);
+        return 63;
+    }
+
+    // 1M values with fractions: lanes are reordered but still double
+    unsigned int count = 1000000;
+    float *values = malloc(count * sizeof(float));
+    if (values == NULL) return 1;
+    expected = 0;
+    for (unsigned int position = 0; position < count; position += 1) {
+        values[position] = (position % 10000) / 100.0f + 0.01f;
+        expected += values[position];
+    }
+
+    sum = sum_snapshot_values(values, count);
+    free(values);
+    if (sum - expected > expected * 1e-12 || expected - sum > expected * 1e-12) {
+        printf("Error in sum_snapshot_values, %.6f instead of %.6f\n", sum, expected);
+        return 144;
+    }
+
+    if (top_snapshot_values(snapshot.cpu, snapshot.length, 3, indexes) != 3 || snapshot.cpu[indexes[0]] != 99 || snapshot.cpu[indexes[1]] != 98 || snapshot.cpu[indexes[2]] != 97) {
+        puts("Error in top_snapshot_values");
+        return 64;
+    }
+
+    free_proc_snapshot(&snapshot);
+    clean_proc_list(list);
+    return 0;
+}
+
+/*
+  * This function tests the process tree with synthetic trees from depth 1 to 10000.
+*/
+char test_tree(void) {
+    unsigned int depths[] = {1, 2, 10, 1000, 10000};
+
+    for (unsigned int depth_index = 0; depth_index < 5; depth_index += 1) {
+        unsigned int depth = depths[depth_index];
+        StartProcList *list = malloc(sizeof(StartProcList));
+        if (list == NULL) return 1;
+        init_proc_list_with_pool(list, 0);
+
+        for (unsigned int pid = depth; pid >= 1; pid -= 1) {    // chain 1 <- 2 <- ... <- depth, children first
+            ProcessElementList *process = new_proc(list);
+            process->pid = pid;
+            process->ppid = pid - 1;
+            process->cpu_usage = 1;
+            process->memory_usage = 0.5;
+            add_proc(list, process);
+
+            process = new_proc(list);               // leaf sibling of each chain process
+            process->pid = 100000 + pid;
+            process->ppid = pid - 1;
+            process->cpu_usage = 2;
+            add_proc(list, process);
+        }
+
+        ProcTree tree;
+        if (build_proc_tree(list, &tree)) {
+            puts("Error in build_proc_tree");
+            return 65;
+        }
+
+        ProcessElementList **subtree;
+        unsigned int length = get_proc_subtree(&tree, 1, &subtree);
+        if (length != 2 * depth - 1 || subtree[0]->pid != 1 || get_proc_subtree_cpu(&tree, 1) != 3 * depth - 2 || get_proc_subtree_memory(&tree, 1) != 0.5 * depth) {
+            printf("Error in get_proc_subtree at depth %u: %u processes, cpu %f\n", depth, length, get_proc_subtree_cpu(&tree, 1));
+            return 66;
+        }
+
+        for (unsigned int position = 1; position < length; position += 1) {
+            unsigned int pid = subtree[position]->pid;
+            if ((pid < 2 || pid > depth) && (pid < 100002 || pid > 100000 + depth)) {
+                printf("Error in get_proc_subtree at depth %u: PID %u is not a descendant\n", depth, pid);
+                return 67;
+            }
+        }
+
+        ProcessElementList *children[4];
+        if (depth > 1 && (get_proc_children(&tree, 1, children, 4) != 2 || get_proc_tree_parent(&tree, depth)->pid != depth - 1 || get_proc_subtree(&tree, depth, &subtree) != 1)) {
+            printf("Error in get_proc_children or get_proc_tree_parent at depth %u\n", depth);
+            return 68;
+        }
+
+        if (get_proc_tree_parent(&tree, 1) != NULL || get_proc_subtree(&tree, 100001, &subtree) != 1 || get_proc_subtree(&tree, 424242, &subtree) != 0) {
+            printf("Error in process tree roots at depth %u\n", depth);
+            return 69;
+        }
+
+        free_proc_tree(&tree);
+        clean_proc_list(list);
+    }
+
+    StartProcList *list = malloc(sizeof(StartProcList));       // parent cycle: 1 -> 2 -> 1
+    init_proc_list(list);
+    add_proc(list, make_proc(1, 2));
+    add_proc(list, make_proc(2, 1));
+    add_proc(list, make_proc(3, 2));
+
+    ProcTree tree;
+    ProcessElementList **subtree;
+    build_proc_tree(list, &tree);
+    if (tree.length != 3 || get_proc_subtree(&tree, 1, &subtree) != 3 || get_proc_subtree(&tree, 2, &subtree) != 2) {
+        puts("Error in build_proc_tree with a parent cycle");
+        return 70;
+    }
+
+    free_proc_tree(&tree);
+    clean_proc_list(list);
+    return 0;
+}
+
+typedef struct StressState {
+    ProcPublisher *publisher;
+    atomic_int running;
+    atomic_uint reads;
+    atomic_uint errors;
+} StressState;
+
+/*
+  * This function is a stress test reader: each snapshot must be consistent
+  * (every ppid is the generation, length is 100 + generation % 50).
+*/
+void *stress_reader(void *argument) {
+    StressState *state = argument;
+    ProcReader reader;
+
+    if (register_proc_reader(state->publisher, &reader)) {
+        atomic_fetch_add(&state->errors, 1);
+        return NULL;
+    }
+
+    unsigned long long last_version = 0;
+    while (atomic_load(&state->running)) {
+        ProcSnapshot *snapshot = acquire_proc_snapshot(&reader);
+        if (snapshot == NULL) continue;
+
+        unsigned int generation = snapshot->length ? snapshot->ppid[0] : 0;
+        char error = snapshot->length != 100 + generation % 50 || reader.version < last_version;
+        for (unsigned int position = 0; position < snapshot->length; position += 1) {
+            error |= snapshot->ppid[position] != generation || strcmp(snapshot->strings + snapshot->user[position], "root") != 0;
+        }
+
+        last_version = reader.version;
+        release_proc_snapshot(&reader);
+        if (error) atomic_fetch_add(&state->errors, 1);
+        atomic_fetch_add(&state->reads, 1);
+    }
+
+    unregister_proc_reader(&reader);
+    return NULL;
+}
+
+/*
+  * This function stress tests the publisher with writer churn and parallel readers.
+*/
+char test_concurrent(void) {
+    StressState state;
+    state.publisher = create_proc_publisher();
+    atomic_init(&state.running, 1);
+    atomic_init(&state.reads, 0);
+    atomic_init(&state.errors, 0);
+
+    StartProcList *list = malloc(sizeof(StartProcList));
+    if (list == NULL || state.publisher == NULL) return 1;
+    init_proc_list_with_pool(list, 0);
+
+    pthread_t readers[4];
+    for (unsigned int reader = 0; reader < 4; reader += 1) pthread_create(&readers[reader], NULL, stress_reader, &state);
+
+    double start = now_ns();
+    unsigned int generation = 0;
+    while (now_ns() - start < 3e8) {
+        generation += 1;
+        while (list->length > 100 + generation % 50) remove_proc(list, list->first);
+        while (list->length < 100 + generation % 50) {
+            ProcessElementList *process = new_proc(list);
+            process->pid = rand();
+            set_proc_strings(list, process, "worker", "worker --stress", "root");
+            add_proc(list, process);
+        }
+        for (ProcessElementList *process = list->first; process != NULL; process = process->next) process->ppid = generation;
+
+        if (publish_proc_list(state.publisher, list)) {
+            puts("Error in publish_proc_list");
+            return 71;
+        }
+    }
+
+    atomic_store(&state.running, 0);
+    for (unsigned int reader = 0; reader < 4; reader += 1) pthread_join(readers[reader], NULL);
+
+    if (atomic_load(&state.errors) || atomic_load(&state.reads) == 0) {
+        printf("Error in concurrent snapshots: %u errors in %u reads (%u publications)\n", atomic_load(&state.errors), atomic_load(&state.reads), generation);
+        return 72;
+    }
+
+    destroy_proc_publisher(state.publisher);
+    clean_proc_list(list);
+    return 0;
+}
+
+/*
+  * This function tests reentrant iterators.
+*/
+char test_iterator(void) {
+    StartProcList *list = malloc(sizeof(StartProcList));
+    if (list == NULL) return 1;
+    init_proc_list(list);
+    for (unsigned int pid = 0; pid < 10; pid += 1) add_proc(list, make_proc(pid, 0));
+
+    ProcIterator outer, inner;
+    ProcessElementList *first, *second;
+    unsigned int pairs = 0;
+
+    init_proc_iterator(list, &outer);
+    while ((first = get_next_iterator_proc(&outer)) != NULL) {
+        init_proc_iterator(list, &inner);
+        while ((second = get_next_iterator_proc(&inner)) != NULL) pairs += first->pid < second->pid;
+    }
+
+    if (pairs != 45 || list->position != list->first) {
+        printf("Error in nested iterators: %u pairs\n", pairs);
+        return 73;
+    }
+
+    set_proc_iterator_filter(&outer, even_pid_filter, NULL);
+    goto_last_iterator_position(&outer);
+    unsigned int expected = 8;
+    while ((first = get_precedent_iterator_proc(&outer)) != NULL) {
+        if (first->pid != expected) {
+            printf("Error in filtered get_precedent_iterator_proc: %u instead of %u\n", first->pid, expected);
+            return 74;
+        }
+        expected -= 2;
+    }
+
+    if (seek_iterator_pid(&outer, 5) || get_next_iterator_proc(&outer)->pid != 6 || seek_iterator_pid(&outer, 42) != 1) {
+        puts("Error in seek_iterator_pid");
+        return 75;
+    }
+
+    goto_first_iterator_position(&outer);
+    if (get_next_iterator_proc(&outer)->pid != 0 || get_next_iterator_proc(&outer)->pid != 2) {
+        puts("Error in goto_first_iterator_position");
+        return 76;
+    }
+
+    clean_proc_list(list);
+    return 0;
+}
+
+/*
+  * This function tests the positional index against an array model with random operations.
+*/
+char test_positions(void) {
+    StartProcList *list = malloc(sizeof(StartProcList));
+    if (list == NULL) return 1;
+    init_proc_list_with_pool(list, 0);
+
+    unsigned int model[6000];
+    unsigned int length = 0, next_pid = 0;
+    for (; length < 100; length += 1) {
+        ProcessElementList *process = new_proc(list);
+        process->pid = model[length] = next_pid++;
+        add_proc(list, process);
+    }
+
+    if (enable_proc_positions(list)) {
+        puts("Error in enable_proc_positions");
+        return 77;
+    }
+
+    srand(7);
+    for (unsigned int operation = 0; operation < 20000; operation += 1) {
+        unsigned int action = rand() % 6;
+        unsigned int index = length ? rand() % length : 0;
+        ProcessElementList *process;
+
+        if (action <= 2 && length < 6000) {
+            process = new_proc(list);
+            process->pid = next_pid++;
+            if (action == 0) {
+                insert_proc(list, process, index);
+            } else if (action == 1 && length) {
+                insert_after_proc(list, process, get_proc(list, index));
+                index += 1;
+            } else {
+                add_proc(list, process);
+                index = length;
+            }
+            memmove(model + index + 1, model + index, (length - index) * sizeof(unsigned int));
+            model[index] = process->pid;
+            length += 1;
+        } else if (action == 3 && length) {
+            remove_proc_index(list, index);
+            memmove(model + index, model + index + 1, (length - index - 1) * sizeof(unsigned int));
+            length -= 1;
+        } else if (action == 4 && length) {
+            remove_proc(list, get_proc(list, index));
+            memmove(model + index, model + index + 1, (length - index - 1) * sizeof(unsigned int));
+            length -= 1;
+        } else if (length) {
+            free_proc(list, rand() % 2 ? pop_proc(list) : popleft_proc(list));
+            length = list->length;
+            memmove(model, model + (list->first != NULL && list->first->pid != model[0]), length * sizeof(unsigned int));
+        }
+
+        if (list->length != length) {
+            printf("Error in positional index, length %u instead of %u\n", list->length, length);
+            return 78;
+        }
+
+        if (length && (process = get_proc(list, index % length)) -> pid != model[index % length]) {
+            printf("Error in positional index, get_proc(%u) returns %u instead of %u\n", index % length, process->pid, model[index % length]);
+            return 79;
+        }
+    }
+
+    unsigned int index = 0;
+    for (ProcessElementList *process = list->first; process != NULL; process = process->next, index += 1) {
+        if (get_proc(list, index) != process) {
+            printf("Error in positional index, get_proc(%u) is not the list process\n", index);
+            return 80;
+        }
+    }
+
+    for (; length < 6000; length += 1) {
+        ProcessElementList *process = new_proc(list);
+        process->pid = model[length] = next_pid++;
+        add_proc(list, process);
+    }
+
+    for (; length > 50; length -= 1) {
+        index = rand() % length;
+        remove_proc_index(list, index);
+        memmove(model + index, model + index + 1, (length - index - 1) * sizeof(unsigned int));
+    }
+
+    for (index = 0; index < length; index += 1) {
+        if (get_proc(list, index)->pid != model[index]) {
+            printf("Error in positional index after shrinking, get_proc(%u) returns %u\n", index, get_proc(list, index)->pid);
+            return 80;
+        }
+    }
+
+    clean_proc_list(list);
+    return 0;
+}
+
+/*
+  * This function is used for tests and checks a view is sorted and complete.
+*/
+char check_view(ProcSortedView *view, unsigned int length) {
+    if (view->length != length) return 1;
+    for (unsigned int position = 1; position < view->length; position += 1) {
+        if (view->compare(view->processes[position - 1], view->processes[position]) > 0) return 1;
+    }
+    return 0;
+}
+
+/*
+  * This function tests list sorting and sorted views maintenance.
+*/
+char test_sort(void) {
+    StartProcList *list = malloc(sizeof(StartProcList));
+    if (list == NULL) return 1;
+    init_proc_list_with_pool(list, 0);
+    enable_proc_positions(list);
+
+    srand(3);
+    for (unsigned int pid = 0; pid < 3000; pid += 1) {
+        ProcessElementList *process = new_proc(list);
+        process->pid = 3000 - pid;
+        process->cpu_usage = rand() % 100;
+        process->memory_usage = rand() % 10;
+        process->start_timestamp = pid / 10;
+        add_proc(list, process);
+    }
+
+    sort_proc_list(list, compare_proc_memory_usage);
+    sort_proc_list(list, compare_proc_cpu_usage);        // stable: memory order kept for same CPU
+    ProcessElementList *process = list->first;
+    unsigned int index = 0;
+
+    for (; process->next != NULL; process = process->next, index += 1) {
+        if (process->cpu_usage < process->next->cpu_usage || (process->cpu_usage == process->next->cpu_usage && process->memory_usage < process->next->memory_usage) || process->next->precedent != process || get_proc(list, index) != process) {
+            printf("Error in sort_proc_list at index %u\n", index);
+            return 81;
+        }
+    }
+
+    if (process != list->last || list->first->precedent != NULL) {
+        puts("Error in sort_proc_list, first or last process");
+        return 82;
+    }
+
+    sort_proc_list(list, compare_proc_pid);
+    if (list->first->pid != 1 || list->last->pid != 3000 || get_proc(list, 41)->pid != 42) {
+        puts("Error in sort_proc_list by PID");
+        return 83;
+    }
+
+    ProcSortedView view;
+    if (init_proc_view(&view, list, compare_proc_cpu_usage) || check_view(&view, 3000)) {
+        puts("Error in init_proc_view");
+        return 84;
+    }
+
+    ProcDiff diff;
+    init_proc_diff(&diff);
+    ProcessElementList *created[50], *exited[50];
+    diff.created = created;
+    diff.exited = exited;
+
+    for (unsigned int round = 0; round < 50; round += 1) {
+        for (unsigned int change = 0; change < 30; change += 1) get_proc(list, rand() % list->length)->cpu_usage = rand() % 100;
+        diff.created_length = diff.exited_length = 0;
+
+        for (unsigned int change = 0; change < 5; change += 1) {
+            process = popleft_proc(list);
+            process->flags |= PROC_FLAG_EXITED;
+            exited[diff.exited_length++] = process;
+
+            process = new_proc(list);
+            process->pid = 10000 + round * 5 + change;
+            process->cpu_usage = rand() % 100;
+            add_proc(list, process);
+            created[diff.created_length++] = process;
+        }
+
+        if (update_proc_view(&view, &diff) || check_view(&view, list->length)) {
+            printf("Error in update_proc_view at round %u (%u processes)\n", round, view.length);
+            return 85;
+        }
+
+        for (unsigned int position = 0; position < view.length; position += 1) {
+            if (view.processes[position]->flags & PROC_FLAG_EXITED) {
+                printf("Error in update_proc_view at round %u, exited process in the view\n", round);
+                return 86;
+            }
+        }
+
+        for (unsigned int position = 0; position < diff.exited_length; position += 1) free_proc(list, exited[position]);
+    }
+
+    free_proc_view(&view);
+    clean_proc_list(list);
+    return 0;
+}
+
+/*
+  * This function tests the top-K tracker against a full sort.
+*/
+char test_top(void) {
+    StartProcList *list = malloc(sizeof(StartProcList));
+    if (list == NULL) return 1;
+    init_proc_list_with_pool(list, 0);
+
+    srand(5);
+    for (unsigned int pid = 0; pid < 5000; pid += 1) {
+        ProcessElementList *process = new_proc(list);
+        process->pid = pid;
+        process->cpu_usage = rand() % 1000 / 10.0;
+        process->memory_usage = rand() % 1000 / 10.0;
+        add_proc(list, process);
+    }
+
+    ProcTopK top;
+    ProcessElementList *result[50];
+    ProcCompare compares[] = {compare_proc_cpu_usage, compare_proc_memory_usage};
+
+    for (unsigned int round = 0; round < 6; round += 1) {
+        ProcCompare compare = compares[round % 2];
+        unsigned int k = round < 2 ? 10 : 50;
+        init_proc_top(&top, k, compare);
+
+        if (round < 4) {
+            fill_proc_top(&top, list);
+        } else {                                     // maintained while values increase
+            fill_proc_top(&top, list);
+            for (unsigned int change = 0; change < 200; change += 1) {
+                ProcessElementList *process = get_proc(list, rand() % list->length);
+                process->cpu_usage += rand() % 50;
+                process->memory_usage += rand() % 50;
+                update_proc_top(&top, process);
+            }
+        }
+
+        unsigned int length = get_proc_top(&top, result);
+        sort_proc_list(list, compare);
+        ProcessElementList *process = list->first;
+
+        for (unsigned int position = 0; position < k; position += 1, process = process->next) {
+            if (length != k || compare(result[position], process) != 0) {
+                printf("Error in top-K at round %u, position %u differs from the full sort\n", round, position);
+                return 87;
+            }
+        }
+
+        free_proc_top(&top);
+    }
+
+    init_proc_top(&top, 3, compare_proc_pid);
+    fill_proc_top(&top, list);
+    remove_proc_top(&top, get_proc_pid(list, 1));
+    if (get_proc_top(&top, result) != 2 || result[0]->pid != 0 || result[1]->pid != 2) {
+        puts("Error in remove_proc_top");
+        return 88;
+    }
+
+    free_proc_top(&top);
+    clean_proc_list(list);
+    return 0;
+}
+
+/*
+  * This function tests the binary snapshot file writer and mapped reader.
+*/
+char test_snapshot_file(void) {
+    StartProcList *list = malloc(sizeof(StartProcList));
+    if (list == NULL) return 1;
+    init_proc_list_with_pool(list, 0);
+
+    for (unsigned int pid = 1; pid <= 1000; pid += 1) {
+        ProcessElementList *process = new_proc(list);
+        process->pid = pid;
+        process->ppid = pid / 2;
+        process->tty = pid % 2;
+        process->cpu_usage = pid / 100.0;
+        process->start_timestamp = 1466607358.5 + pid;
+        set_proc_strings(list, process, "/usr/bin/java", pid % 3 ? "java -jar app.jar" : "java -jar other.jar", "app");
+        add_proc(list, process);
+    }
+
+    char path[] = "/tmp/proclist_tests_snapshot.bin";
+    if (write_proc_snapshot_file(list, path)) {
+        puts("Error in write_proc_snapshot_file");
+        return 89;
+    }
+
+    ProcSnapshotFile file;
+    if (open_proc_snapshot_file(&file, path)) {
+        puts("Error in open_proc_snapshot_file");
+        return 90;
+    }
+
+    const ProcRecord *record = get_proc_record(&file, 299);
+    if (file.length != 1000 || record->pid != 300 || record->ppid != 150 || record->tty != 0 || record->cpu_usage != 3.0f || record->start_timestamp != 1466607658.5 || strcmp(get_proc_record_string(&file, record->cmdline), "java -jar other.jar") || strcmp(get_proc_record_string(&file, record->user), "app") || get_proc_record(&file, 1000) != NULL) {
+        puts("Error in snapshot file records");
+        return 91;
+    }
+
+    close_proc_snapshot_file(&file);
+
+    FILE *corrupted = fopen(path, "r+b");
+    fputc('X', corrupted);
+    fclose(corrupted);
+
+    if (open_proc_snapshot_file(&file, path) == 0) {
+        puts("Error in open_proc_snapshot_file, corrupted file is opened");
+        return 92;
+    }
+
+    ProcFileHeader header;
+    corrupted = fopen(path, "r+b");
+    fread(&header, sizeof(header), 1, corrupted);
+    memcpy(header.magic, PROC_FILE_MAGIC, sizeof(header.magic));
+
+    ProcFileHeader crafted[3] = {header, header, header};
+    crafted[0].strings_offset = UINT64_MAX - 8;      // strings_offset + strings_size wraps
+    crafted[0].strings_size = 16;
+    crafted[1].records_offset = UINT64_MAX - 7;      // records_offset + records wraps
+    crafted[2].length = UINT32_MAX;                  // records beyond the end of the file
+    crafted[2].strings_offset = UINT64_MAX - header.strings_size + 1;
+
+    for (unsigned int position = 0; position < 3; position += 1) {
+        rewind(corrupted);
+        fwrite(&crafted[position], sizeof(ProcFileHeader), 1, corrupted);
+        fflush(corrupted);
+
+        if (open_proc_snapshot_file(&file, path) == 0) {
+            printf("Error in open_proc_snapshot_file, crafted header %u is opened\n", position);
+            return 136;
+        }
+    }
+
+    fclose(corrupted);
+    remove(path);
+    clean_proc_list(list);
+    return 0;
+}
+
+/*
+  * This function tests the delta-encoded history.
+*/
+char test_history(void) {
+    ProcHistory *history = create_proc_history(4);
+    if (history == NULL) return 1;
+
+    for (unsigned int tick = 0; tick < 10; tick += 1) {
+        StartProcList *list = malloc(sizeof(StartProcList));
+        init_proc_list_with_pool(list, 0);
+        fill_history_tick(list, tick, 100);
+
+        if (record_proc_history(history, list)) {
+            puts("Error in record_proc_history");
+            return 93;
+        }
+
+        clean_proc_list(list);
+    }
+
+    unsigned long long first, last;
+    if (get_proc_history_ticks(history, &first, &last) || first != 5 || last != 9) {
+        puts("Error in get_proc_history_ticks");
+        return 94;
+    }
+
+    for (unsigned long long tick = first; tick <= last; tick += 1) {
+        StartProcList *restored = malloc(sizeof(StartProcList));
+        StartProcList *expected = malloc(sizeof(StartProcList));
+        init_proc_list(restored);
+        init_proc_list(expected);
+        fill_history_tick(expected, tick, 100);
+
+        if (restore_proc_history(history, tick, restored) || restored->length != expected->length) {
+            printf("Error in restore_proc_history for tick %llu\n", tick);
+            return 95;
+        }
+
+        for (ProcessElementList *process = expected->first; process != NULL; process = process->next) {
+            ProcessElementList *restored_process = get_proc_pid(restored, process->pid);
+            if (restored_process == NULL || restored_process->start_timestamp != process->start_timestamp || restored_process->cpu_usage != process->cpu_usage || strcmp(restored_process->cmdline, process->cmdline)) {
+                printf("Error in restored process %u for tick %llu\n", process->pid, tick);
+                return 96;
+            }
+        }
+
+        clean_proc_list(restored);
+        clean_proc_list(expected);
+    }
+
+    StartProcList *restored = malloc(sizeof(StartProcList));
+    init_proc_list(restored);
+    if (restore_proc_history(history, 4, restored) == 0) {
+        puts("Error in restore_proc_history, discarded tick is restored");
+        return 97;
+    }
+
+    clean_proc_list(restored);
+    destroy_proc_history(history);
+    return 0;
+}
+
+/*
+  * This function tests batch insertion, splice and split.
+*/
+char test_batch(void) {
+    StartProcList *list = malloc(sizeof(StartProcList));
+    if (list == NULL) return 1;
+    init_proc_list_with_pool(list, 0);
+
+    ProcessElementList *processes[100];
+    for (unsigned int pid = 0; pid < 100; pid += 1) {
+        processes[pid] = new_proc(list);
+        processes[pid]->pid = pid < 50 ? pid : pid + 100;
+        set_proc_strings(list, processes[pid], "bash", "bash", "root");
+    }
+
+    add_procs(list, processes, 100);
+    if (list->length != 100 || list->first != processes[0] || list->last != processes[99] || get_proc(list, 99) != processes[99] || processes[50]->precedent != processes[49]) {
+        puts("Error in add_procs");
+        return 98;
+    }
+
+    for (unsigned int indexes = 0; indexes < 2; indexes += 1) {
+        if (indexes) {
+            enable_proc_pid_index(list);
+            enable_proc_positions(list);
+        }
+
+        StartProcList *shard = malloc(sizeof(StartProcList));
+        init_proc_list_with_pool(shard, 0);
+        for (unsigned int pid = 50; pid < 150; pid += 1) {
+            ProcessElementList *process = new_proc(shard);
+            process->pid = pid;
+            set_proc_strings(shard, process, "worker", "worker --shard", "root");
+            add_proc(shard, process);
+        }
+
+        if (splice_proc_list(list, shard, processes[49]) || list->length != 200 || shard->length != 0 || shard->first != NULL) {
+            puts("Error in splice_proc_list");
+            return 99;
+        }
+
+        for (unsigned int index = 0; index < 200; index += 1) {
+            ProcessElementList *process = get_proc(list, index);
+            if (process == NULL || process->pid != index || (indexes && get_proc_pid(list, index) != process) || strcmp(process->cmdline, index >= 50 && index < 150 ? "worker --shard" : "bash")) {
+                printf("Error in spliced list at %u\n", index);
+                return 100;
+            }
+        }
+
+        for (unsigned int pid = 50; pid < 150; pid += 1) remove_proc(list, get_proc(list, 50));
+        clean_proc_list(shard);
+
+        if (list->length != 100 || count_proc_strings(list) != 2 || get_proc(list, 50) != processes[50]) {
+            puts("Error in list after removing spliced processes");
+            return 101;
+        }
+    }
+
+    StartProcList *tail = malloc(sizeof(StartProcList));
+    init_proc_list(tail);
+    split_proc_list(list, processes[60], tail);
+
+    if (list->length != 60 || list->last != processes[59] || processes[59]->next != NULL || tail->length != 40 || tail->first != processes[60] || tail->last != processes[99] || get_proc(list, 59) != processes[59] || get_proc_pid(list, 160) != NULL) {
+        puts("Error in split_proc_list");
+        return 102;
+    }
+
+    splice_proc_list(list, tail, NULL);
+    if (list->length != 100 || list->first != processes[60] || get_proc(list, 40) != processes[0] || get_proc_pid(list, 160) != processes[60] || list->last != processes[59]) {
+        puts("Error in splice_proc_list at the beginning");
+        return 103;
+    }
+
+    clean_proc_list(tail);
+
+    tail = malloc(sizeof(StartProcList));
+    init_proc_list_with_pool(tail, 0);
+    ProcessElementList *own = new_proc(tail);
+    set_proc_strings(tail, own, "tail", "tail -f", "root");
+    add_proc(tail, own);
+
+    if (split_proc_list(list, get_proc(list, 50), tail) || tail->length != 51 || list->length != 50) {
+        puts("Error in split_proc_list with a pooled list");
+        return 137;
+    }
+
+    clean_proc_list(tail);                           // moved processes are released in the shared pool
+    ProcessElementList *recycled = new_proc(list);
+    recycled->pid = 1000;
+    set_proc_strings(list, recycled, "bash", "bash -l", "root");
+    add_proc(list, recycled);
+
+    if (list->length != 51 || strcmp(list->last->cmdline, "bash -l") || strcmp(list->first->cmdline, "bash")) {
+        puts("Error in list after cleaning its split processes");
+        return 137;
+    }
+
+    // the unused part of the adopted chunks is handed out by the list pool
+    tail = malloc(sizeof(StartProcList));
+    init_proc_list_with_pool(tail, 0);
+    for (unsigned int pid = 2000; pid < 2010; pid += 1) {
+        ProcessElementList *process = new_proc(tail);
+        process->pid = pid;
+        add_proc(tail, process);
+    }
+
+    splice_proc_list(list, tail, list->last);
+    clean_proc_list(tail);
+    for (unsigned int pid = 3000; pid < 4000; pid += 1) {
+        ProcessElementList *process = new_proc(list);
+        process->pid = pid;
+        add_proc(list, process);
+    }
+
+    if (list->length != 1061 || get_proc_pid(list, 2009) == NULL || get_proc_pid(list, 2009)->next->pid != 3000 || get_proc_pid(list, 3999) != list->last) {
+        puts("Error in new_proc after splicing a pooled list");
+        return 143;
+    }
+
+    clean_proc_list(list);
+    return 0;
+}
+
+/*
+  * This function applies process connector events until a condition
+  * on the child process is true or for about 2 seconds.
+  * This function returns 1 if the condition is true.
+*/
+char wait_proc_events(StartProcList *list, ProcEvents *events, ProcDiff *diff, pid_t child, char exited) {
+    struct pollfd descriptor = {get_proc_events_fd(events), POLLIN, 0};
+
+    for (unsigned int wait = 0; wait < 20; wait += 1) {
+        poll(&descriptor, 1, 100);
+        apply_proc_events(list, events, diff);
+
+        ProcessElementList *process = get_proc_pid(list, child);
+        if (exited && process == NULL && contains_proc(diff->exited, diff->exited_length, child)) return 1;
+        if (!exited && process != NULL && process->cmdline != NULL && strcmp(process->cmdline, "sleep 30") == 0) return 1;
+    }
+
+    return 0;
+}
+
+/*
+  * This function tests the process connector event source with a child
+  * process (skipped when the connector is not available).
+*/
+char test_events(void) {
+    ProcEvents *events = open_proc_events();
+    if (events == NULL) {
+        puts("Process connector is not available, events test skipped");
+        return 0;
+    }
+
+    StartProcList *list = malloc(sizeof(StartProcList));
+    if (list == NULL) return 1;
+    init_proc_list_with_pool(list, 0);
+    scan_procs(list);
+
+    ProcDiff diff;
+    init_proc_diff(&diff);
+
+    pid_t child = fork();
+    if (child == 0) {
+        execl("/bin/sleep", "sleep", "30", NULL);
+        _exit(1);
+    }
+
+    if (!wait_proc_events(list, events, &diff, child, 0)) {
+        kill(child, SIGKILL);
+        waitpid(child, NULL, 0);
+
+        if (get_proc_pid(list, child) == NULL) {
+            puts("Process connector events are not delivered, events test skipped");
+            close_proc_events(events);
+            clean_proc_diff(list, &diff);
+            clean_proc_list(list);
+            return 0;
+        }
+
+        puts("Error in apply_proc_events, exec not applied");
+        return 117;
+    }
+
+    kill(child, SIGKILL);
+    waitpid(child, NULL, 0);
+
+    if (!wait_proc_events(list, events, &diff, child, 1)) {
+        puts("Error in apply_proc_events, exit not applied");
+        return 118;
+    }
+
+    if (get_proc_pid(list, getpid()) == NULL) {
+        puts("Error in apply_proc_events, current process is lost");
+        return 119;
+    }
+
+    close_proc_events(events);
+    clean_proc_diff(list, &diff);
+    clean_proc_list(list);
+    return 0;
+}
+
+/*
+  * This function tests compiled queries against hand-written predicates.
+*/
+char test_query(void) {
+    StartProcList *list = malloc(sizeof(StartProcList));
+    if (list == NULL) return 1;
+    init_proc_list_with_pool(list, 0);
+
+    char cmdline[64];
+    for (unsigned int pid = 1; pid <= 300; pid += 1) {
+        ProcessElementList *process = new_proc(list);
+        process->pid = pid;
+        process->ppid = pid / 2;
+        process->cpu_usage = pid % 10;
+        snprintf(cmdline, sizeof(cmdline), pid % 3 ? "postgres --replica %u" : "postgres \"primary\" %u", pid);
+        set_proc_strings(list, process, "postgres", cmdline, pid % 4 ? "postgres" : "root");
+        add_proc(list, process);
+    }
+
+    ProcQuery *query = compile_proc_query("cmdline contains \"--replica\" && user == \"postgres\" && cpu_usage > 5");
+    ProcessElementList *matches[300];
+    unsigned int expected = 0;
+    for (ProcessElementList *process = list->first; process != NULL; process = process->next) {
+        expected += strstr(process->cmdline, "--replica") != NULL && strcmp(process->user, "postgres") == 0 && process->cpu_usage > 5;
+    }
+
+    if (query == NULL || select_proc_query(list, query, matches, 300) != expected || expected == 0) {
+        puts("Error in select_proc_query");
+        return 120;
+    }
+
+    for (unsigned int position = 0; position < expected; position += 1) {
+        if (matches[position]->pid % 3 == 0 || matches[position]->pid % 4 == 0 || matches[position]->cpu_usage <= 5) {
+            printf("Error in select_proc_query, process %u does not match\n", matches[position]->pid);
+            return 121;
+        }
+    }
+
+    free_proc_query(query);
+    query = compile_proc_query("!(pid >= 10 || ppid == 2) || (cmdline contains \"\\\"primary\\\"\" && user != \"root\" && pid < 30)");
+    if (query == NULL) {
+        puts("Error in compile_proc_query with escaped strings");
+        return 122;
+    }
+
+    ProcIterator iterator;
+    ProcessElementList *process;
+    init_proc_iterator(list, &iterator);
+    set_proc_iterator_filter(&iterator, match_proc_query, query);
+    expected = 0;
+    while ((process = get_next_iterator_proc(&iterator)) != NULL) {
+        char keep = !(process->pid >= 10 || process->ppid == 2) || (process->pid % 3 == 0 && process->pid % 4 && process->pid < 30);
+        if (!keep) {
+            printf("Error in match_proc_query, process %u does not match\n", process->pid);
+            return 123;
+        }
+        expected += 1;
+    }
+
+    if (expected != 11) {
+        printf("Error in match_proc_query: %u matches\n", expected);
+        return 124;
+    }
+
+    free_proc_query(query);
+    const char *invalid[] = {"", "pid", "pid >", "cpu_usage > \"5\"", "user > \"a\"", "pid contains 5", "name == \"a\"", "(pid == 1", "pid == 1 &&", "user == \"a", "pid == 1 pid == 2"};
+    for (unsigned int position = 0; position < sizeof(invalid) / sizeof(invalid[0]); position += 1) {
+        query = compile_proc_query(invalid[position]);
+        if (query != NULL) {
+            printf("Error in compile_proc_query, %s is compiled\n", invalid[position]);
+            return 125;
+        }
+    }
+
+    // nesting is limited, deep expressions fail instead of overflowing the stack
+    char *nested = malloc(200001 + 16);
+    if (nested == NULL) return 1;
+    for (unsigned int depth = 0; depth < 2; depth += 1) {
+        unsigned int count = depth ? 100000 : 200;
+        memset(nested, '(', count);
+        strcpy(nested + count, "pid == 1");
+        memset(nested + count + 8, ')', count);
+        nested[count * 2 + 8] = 0;
+        query = compile_proc_query(nested);
+        if ((query == NULL) != depth) {
+            printf("Error in compile_proc_query, %u nested parentheses\n", count);
+            return 140;
+        }
+        if (query != NULL) free_proc_query(query);
+
+        memset(nested, '!', count);
+        strcpy(nested + count, "pid == 1");
+        query = compile_proc_query(nested);
+        if ((query == NULL) != depth) {
+            printf("Error in compile_proc_query, %u nested negations\n", count);
+            return 140;
+        }
+        if (query != NULL) free_proc_query(query);
+    }
+
+    free(nested);
+    clean_proc_list(list);
+    return 0;
+}
+
+/*
+  * This function returns 1 if search_procs with the trigram index finds the same processes as a linear search.
+*/
+char check_trigram_search(StartProcList *list, const char *text) {
+    ProcessElementList **matches = malloc((list->length + 1) * sizeof(ProcessElementList *));
+    unsigned int count = search_procs(list, text, matches, list->length), expected = 0;
+
+    for (ProcessElementList *process = list->first; process != NULL; process = process->next) {
+        if ((process->cmdline == NULL || strstr(process->cmdline, text) == NULL) && (process->executable == NULL || strstr(process->executable, text) == NULL)) continue;
+
+        unsigned int position = 0;
+        while (position < count && matches[position] != process) position += 1;
+        if (position == count) {
+            free(matches);
+            return 0;
+        }
+
+        expected += 1;
+    }
+
+    free(matches);
+    return count == expected;
+}
+
+/*
+  * This function tests the trigram index used by search_procs.
+*/
+char test_trigrams(void) {
+    static const char *searches[] = {"--port 5", "java", "-Xmx", "worker-12 ", "worker-1", "python3", "ab", "nothing here", "port 50 --log", "--"};
+    StartProcList *list = malloc(sizeof(StartProcList));
+    if (list == NULL) return 1;
+    init_proc_list_with_pool(list, 0);
+
+    char cmdline[128];
+    for (unsigned int pid = 1; pid <= 3000; pid += 1) {
+        if (pid == 1500 && enable_proc_trigrams(list)) {
+            puts("Error in enable_proc_trigrams");
+            return 126;
+        }
+
+        ProcessElementList *process = new_proc(list);
+        process->pid = pid;
+        snprintf(cmdline, sizeof(cmdline), "%s -Xmx%um worker-%u --port %u --log", pid % 3 ? "java" : "python3", pid % 8, pid % 40, pid);
+        set_proc_strings(list, process, pid % 3 ? "/usr/bin/java" : "/usr/bin/python3", cmdline, "daemon");
+        add_proc(list, process);
+    }
+
+    for (unsigned int search = 0; search < sizeof(searches) / sizeof(searches[0]); search += 1) {
+        if (!check_trigram_search(list, searches[search])) {
+            printf("Error in search_procs for \"%s\"\n", searches[search]);
+            return 127;
+        }
+    }
+
+    ProcessElementList *process = list->first;
+    while (process != NULL) {
+        ProcessElementList *next = process->next;
+        if (process->pid % 4) {
+            remove_proc(list, process);
+        } else if (process->pid % 8 == 0) {
+            snprintf(cmdline, sizeof(cmdline), "/usr/sbin/nginx -g daemon-%u", process->pid);
+            set_proc_strings(list, process, "nginx", cmdline, "www-data");
+        }
+        process = next;
+    }
+
+    if (!check_trigram_search(list, "nginx -g") || !check_trigram_search(list, "--port 5") || !check_trigram_search(list, "daemon-8")) {
+        puts("Error in search_procs after removals and set_proc_strings");
+        return 128;
+    }
+
+    StartProcList *other = malloc(sizeof(StartProcList));
+    init_proc_list(other);
+    enable_proc_trigrams(other);
+    split_proc_list(list, get_proc(list, 100), other);
+    if (!check_trigram_search(list, "--port") || !check_trigram_search(other, "--port") || search_procs(list, "--port", NULL, 0) + search_procs(other, "--port", NULL, 0) != 375) {
+        puts("Error in search_procs after split_proc_list");
+        return 129;
+    }
+
+    splice_proc_list(list, other, NULL);
+    if (!check_trigram_search(list, "--port 9") || search_procs(list, "--port", NULL, 0) != 375 || search_procs(other, "--port", NULL, 0) != 0) {
+        puts("Error in search_procs after splice_proc_list");
+        return 130;
+    }
+
+    clean_proc_list(other);
+    clean_proc_list(list);
+    return 0;
+}
+
+/*
+  * This function tests the compact storage and the conversions with the list.
+*/
+char test_compact(void) {
+    StartProcList *list = malloc(sizeof(StartProcList));
+    if (list == NULL) return 1;
+    init_proc_list_with_pool(list, 0);
+    fill_history_tick(list, 0, 1000);
+    list->first->start_timestamp = 1466607358.25L;
+
+    ProcCompactList compact;
+    init_proc_compact(&compact);
+    if (compact_proc_list(&compact, list) || compact.length != 1000 || sizeof(ProcCompactNode) > 56) {
+        puts("Error in compact_proc_list");
+        return 131;
+    }
+
+    ProcessElementList *process = list->first;
+    for (unsigned int node = compact.first; node != PROC_COMPACT_NONE; node = compact.nodes[node].next) {
+        if (compact.nodes[node].pid != process->pid || compact.nodes[node].cpu_usage != process->cpu_usage || strcmp(get_proc_compact_string(&compact, compact.nodes[node].cmdline), process->cmdline) || compact.nodes[node].start_timestamp / 1000000000.0L != process->start_timestamp) {
+            printf("Error in compact node %u\n", node);
+            return 132;
+        }
+        process = process->next;
+    }
+
+    for (unsigned int pid = 2; pid <= 1000; pid += 2) remove_proc_compact(&compact, get_proc_compact_pid(&compact, pid));
+    unsigned int used = compact.used;
+    unsigned int node = new_proc_compact(&compact, 5000);
+    if (set_proc_compact_strings(&compact, node, "nginx", "nginx -g", NULL) || compact.used != used || compact.length != 501 || compact.nodes[compact.last].pid != 5000 || get_proc_compact_pid(&compact, 4) != PROC_COMPACT_NONE) {
+        puts("Error in new_proc_compact or remove_proc_compact");
+        return 133;
+    }
+
+    StartProcList *expanded = malloc(sizeof(StartProcList));
+    init_proc_list(expanded);
+    if (expand_proc_compact(&compact, expanded) || expanded->length != 501 || expanded->first->start_timestamp != 1466607358.25L || strcmp(expanded->last->cmdline, "nginx -g") || get_proc_pid(expanded, 999) == NULL || get_proc_pid(expanded, 998) != NULL) {
+        puts("Error in expand_proc_compact");
+        return 134;
+    }
+
+    // released strings are packed, offsets of the other nodes are rewritten
+    char cmdline[64];
+    for (unsigned int round = 0; round < 20000; round += 1) {
+        snprintf(cmdline, sizeof(cmdline), "worker --round %u", round);
+        if (set_proc_compact_strings(&compact, node, "worker", cmdline, get_proc_compact_string(&compact, compact.nodes[compact.first].user))) return 1;
+    }
+
+    for (unsigned int pid = 1; pid < 1000; pid += 2) {
+        unsigned int found = get_proc_compact_pid(&compact, pid);
+        if (found == PROC_COMPACT_NONE || strcmp(get_proc_compact_string(&compact, compact.nodes[found].cmdline), get_proc_pid(expanded, pid)->cmdline)) {
+            printf("Error in set_proc_compact_strings, PID %u strings are lost\n", pid);
+            return 141;
+        }
+    }
+
+    if (strcmp(get_proc_compact_string(&compact, compact.nodes[node].cmdline), "worker --round 19999") || get_proc_compact_pid(&compact, 5000) != node) {
+        puts("Error in set_proc_compact_strings");
+        return 141;
+    }
+
+    free_proc_compact(&compact);
+    clean_proc_list(expanded);
+    clean_proc_list(list);
+    return 0;
+}
+
 /*
   * Main function to test my process list.
 */
 int main(int argc, char *argv[]) {
+    (void)argc;
     puts("\x1b[s\x1b[31m");
     StartProcList *list = malloc(sizeof(StartProcList));
     
@@ -479,6 +2150,78 @@ int main(int argc, char *argv[]) {
     
     clean_proc_list(list);
     
+    code = test_pid_index();
+    if (code) return code;
+    
+    code = test_pool();
+    if (code) return code;
+    
+    code = test_strings();
+    if (code) return code;
+    
+    code = test_scan(argv[0]);
+    if (code) return code;
+    
+    code = test_refresh();
+    if (code) return code;
+    
+    code = test_usage();
+    if (code) return code;
+    
+    code = test_snapshot();
+    if (code) return code;
+    
+    code = test_tree();
+    if (code) return code;
+    
+    code = test_concurrent();
+    if (code) return code;
+    
+    code = test_iterator();
+    if (code) return code;
+    
+    code = test_positions();
+    if (code) return code;
+    
+    code = test_sort();
+    if (code) return code;
+    
+    code = test_top();
+    if (code) return code;
+    
+    code = test_snapshot_file();
+    if (code) return code;
+
+    code = test_history();
+    if (code) return code;
+
+    code = test_batch();
+    if (code) return code;
+
+    code = test_parallel_scan(argv[0]);
+    if (code) return code;
+
+    code = test_threads();
+    if (code) return code;
+
+    code = test_lazy_fields(argv[0]);
+    if (code) return code;
+
+    code = test_users();
+    if (code) return code;
+
+    code = test_events();
+    if (code) return code;
+
+    code = test_query();
+    if (code) return code;
+
+    code = test_trigrams();
+    if (code) return code;
+
+    code = test_compact();
+    if (code) return code;
+    
     puts("\x1b[u\x1b[0J\x1b[32mTests passed !");
     
     return 0;